@@ -357,11 +357,11 @@ public:
 	}
 
 	constexpr bool operator>=(duration target) const {
-		return _s >= target._s || (_s == target._s && _ns >= target._ns);
+		return _s > target._s || (_s == target._s && _ns >= target._ns);
 	}
 
 	constexpr bool operator<=(duration target) const {
-		return _s <= target._s || (_s == target._s && _ns <= target._ns);
+		return _s < target._s || (_s == target._s && _ns <= target._ns);
 	}
 
 	constexpr duration operator+(duration target) const {
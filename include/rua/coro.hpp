@@ -0,0 +1,567 @@
+#ifndef _RUA_CORO_HPP
+#define _RUA_CORO_HPP
+
+#include "macros.hpp"
+
+#ifdef RUA_COROUTINE_SUPPORTED
+
+#include "bytes.hpp"
+#include "chrono.hpp"
+#include "io/abstract.hpp"
+#include "optional.hpp"
+#include "sched/async.hpp"
+#include "sched/suspender.hpp"
+#include "sched/thread_pool.hpp"
+#include "sorted_list.hpp"
+#include "sync/chan.hpp"
+#include "sync/lockfree_list.hpp"
+#include "sync/lockfree_queue.hpp"
+#include "sync/mutex.hpp"
+#include "sync/waiters.hpp"
+#include "types/util.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <utility>
+
+namespace rua {
+
+template <typename T>
+class _coro_promise_base {
+public:
+	std::suspend_always initial_suspend() noexcept {
+		return {};
+	}
+
+	class final_awaiter {
+	public:
+		bool await_ready() noexcept {
+			return false;
+		}
+
+		template <typename Promise>
+		std::coroutine_handle<>
+		await_suspend(std::coroutine_handle<Promise> h) noexcept {
+			auto cont = h.promise()._cont;
+			return cont ? cont : std::noop_coroutine();
+		}
+
+		void await_resume() noexcept {}
+	};
+
+	final_awaiter final_suspend() noexcept {
+		return {};
+	}
+
+	void unhandled_exception() {
+		_exc = std::current_exception();
+	}
+
+	void set_continuation(std::coroutine_handle<> cont) {
+		_cont = cont;
+	}
+
+protected:
+	std::coroutine_handle<> _cont;
+	std::exception_ptr _exc;
+
+	void _rethrow() {
+		if (_exc) {
+			std::rethrow_exception(_exc);
+		}
+	}
+};
+
+template <typename T>
+class _coro_promise : public _coro_promise_base<T> {
+public:
+	template <typename U>
+	void return_value(U &&val) {
+		_val.emplace(std::forward<U>(val));
+	}
+
+	T take() {
+		this->_rethrow();
+		return std::move(_val.value());
+	}
+
+private:
+	optional<T> _val;
+};
+
+template <>
+class _coro_promise<void> : public _coro_promise_base<void> {
+public:
+	void return_void() {}
+
+	void take() {
+		_rethrow();
+	}
+};
+
+// A lazily started coroutine, it runs when awaited or passed to
+// coro_executor::execute().
+template <typename T = void>
+class coro_task {
+public:
+	class promise_type : public _coro_promise<T> {
+	public:
+		coro_task get_return_object() {
+			return coro_task(
+				std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+	};
+
+	coro_task(coro_task &&src) : _h(std::exchange(src._h, nullptr)) {}
+
+	coro_task &operator=(coro_task &&src) {
+		if (this != &src) {
+			reset();
+			_h = std::exchange(src._h, nullptr);
+		}
+		return *this;
+	}
+
+	~coro_task() {
+		reset();
+	}
+
+	explicit operator bool() const {
+		return static_cast<bool>(_h);
+	}
+
+	void reset() {
+		if (_h) {
+			_h.destroy();
+			_h = nullptr;
+		}
+	}
+
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) {
+		_h.promise().set_continuation(cont);
+		return _h;
+	}
+
+	T await_resume() {
+		return _h.promise().take();
+	}
+
+private:
+	std::coroutine_handle<promise_type> _h;
+
+	explicit coro_task(std::coroutine_handle<promise_type> h) : _h(h) {}
+};
+
+class coro_executor;
+
+inline coro_executor *&_this_coro_executor() {
+	static thread_local coro_executor *exr = nullptr;
+	return exr;
+}
+
+// The executor of the running coroutine.
+inline coro_executor &this_coro_executor() {
+	assert(_this_coro_executor());
+	return *_this_coro_executor();
+}
+
+// Runs coroutines on the thread calling run(). Coroutine frames are allocated
+// by the compiler, so a task costs only its frame instead of a fiber stack.
+//
+// Coroutines that call blocking functions directly (through this_suspender())
+// still work, but block the whole executor, await the coro_* adapters instead.
+class coro_executor {
+	struct _queue_t {
+		lockfree_queue<std::coroutine_handle<>> readys;
+		lockfree_list<resumer_i> waiters;
+
+		void post(std::coroutine_handle<> h) {
+			readys.emplace(h);
+			if (!waiters.empty()) {
+				_resume_one(waiters);
+			}
+		}
+	};
+
+public:
+	coro_executor() :
+		_live_c(0), _que(std::make_shared<_queue_t>()), _spdr(*this) {}
+
+	coro_executor(const coro_executor &) = delete;
+
+	coro_executor &operator=(const coro_executor &) = delete;
+
+	// Can be called from any thread.
+	void execute(coro_task<void> task) {
+		++_live_c;
+		post(_drive(*this, std::move(task))._h);
+	}
+
+	// Resumes h on the executor thread, can be called from any thread.
+	void post(std::coroutine_handle<> h) {
+		_que->post(h);
+	}
+
+	// Posts to the executor without referencing it, so it stays valid while
+	// run() returns and the executor is destroyed on another thread.
+	class poster {
+	public:
+		void post(std::coroutine_handle<> h) const {
+			_que->post(h);
+		}
+
+	private:
+		std::shared_ptr<_queue_t> _que;
+
+		explicit poster(std::shared_ptr<_queue_t> que) : _que(std::move(que)) {}
+
+		friend coro_executor;
+	};
+
+	poster get_poster() const {
+		return poster(_que);
+	}
+
+	// Blocks the current context until all executed tasks are done.
+	void run() {
+		suspender_guard sg(_spdr);
+		auto orig_spdr = sg.previous();
+		_orig_spdr = orig_spdr;
+
+		auto prev_exr = std::exchange(_this_coro_executor(), this);
+
+		while (_live_c.load()) {
+			while (auto h_opt = _que->readys.pop()) {
+				h_opt.value().resume();
+			}
+
+			auto now = tick();
+			while (_timers.size() && _timers.begin()->resume_ti <= now) {
+				auto h = _timers.begin()->h;
+				_timers.erase(_timers.begin());
+				h.resume();
+			}
+
+			if (!_live_c.load() || !_que->readys.empty()) {
+				continue;
+			}
+			_wait_until(
+				_que->waiters,
+				[this]() -> bool { return !_que->readys.empty(); },
+				orig_spdr,
+				_timers.size() ? _timers.begin()->resume_ti - now
+							   : duration_max());
+		}
+
+		_this_coro_executor() = prev_exr;
+		_orig_spdr.reset();
+	}
+
+	// Only for the executor thread.
+	void add_timer(time resume_ti, std::coroutine_handle<> h) {
+		_timers.emplace(_timer_t{resume_ti, h});
+	}
+
+	// Forwards to the suspender run() was called with.
+	class suspender : public rua::suspender {
+	public:
+		explicit suspender(coro_executor &exr) : _exr(&exr) {}
+
+		virtual ~suspender() = default;
+
+		virtual void yield() {
+			_exr->_orig_spdr->yield();
+		}
+
+		virtual void sleep(duration timeout) {
+			_exr->_orig_spdr->sleep(timeout);
+		}
+
+		virtual bool suspend(duration timeout) {
+			return _exr->_orig_spdr->suspend(timeout);
+		}
+
+		virtual resumer_i get_resumer() {
+			return _exr->_orig_spdr->get_resumer();
+		}
+
+		virtual bool is_own_stack() const {
+			return _exr->_orig_spdr->is_own_stack();
+		}
+
+	private:
+		coro_executor *_exr;
+	};
+
+	suspender &get_suspender() {
+		return _spdr;
+	}
+
+private:
+	class _detached_t {
+	public:
+		class promise_type {
+		public:
+			_detached_t get_return_object() {
+				return {std::coroutine_handle<promise_type>::from_promise(
+					*this)};
+			}
+
+			std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+
+			std::suspend_never final_suspend() noexcept {
+				return {};
+			}
+
+			void return_void() {}
+
+			void unhandled_exception() {
+				std::terminate();
+			}
+		};
+
+		std::coroutine_handle<promise_type> _h;
+	};
+
+	struct _timer_t {
+		time resume_ti;
+		std::coroutine_handle<> h;
+
+		bool operator<(const _timer_t &target) const {
+			return resume_ti < target.resume_ti;
+		}
+	};
+
+	std::atomic<size_t> _live_c;
+	std::shared_ptr<_queue_t> _que;
+	sorted_list<_timer_t> _timers;
+	suspender_i _orig_spdr;
+	suspender _spdr;
+
+	static _detached_t _drive(coro_executor &exr, coro_task<void> task) {
+		co_await task;
+		--exr._live_c;
+	}
+};
+
+// Resumes a suspended coroutine on its executor, at most once.
+class coro_resumer : public resumer {
+public:
+	coro_resumer(coro_executor &exr, std::coroutine_handle<> h) :
+		_pstr(exr.get_poster()), _h(h), _is_resumed(false) {}
+
+	virtual ~coro_resumer() = default;
+
+	virtual void resume() {
+		if (!_is_resumed.exchange(true)) {
+			_pstr.post(_h);
+		}
+	}
+
+private:
+	coro_executor::poster _pstr;
+	std::coroutine_handle<> _h;
+	std::atomic<bool> _is_resumed;
+};
+
+// Like _wait_until(), cond() is also evaluated while the waiter list is
+// locked. The caller awaits it again until cond() returns true.
+template <typename Cond>
+class _coro_waiter {
+public:
+	_coro_waiter(
+		lockfree_list<resumer_i> &waiters,
+		Cond &cond,
+		resumer_i *rsmr_out = nullptr) :
+		_waiters(waiters), _cond(cond), _rsmr_out(rsmr_out) {}
+
+	bool await_ready() {
+		return _cond();
+	}
+
+	bool await_suspend(std::coroutine_handle<> h) {
+		resumer_i rsmr(std::make_shared<coro_resumer>(this_coro_executor(), h));
+		if (_rsmr_out) {
+			*_rsmr_out = rsmr;
+		}
+		return _waiters.emplace_front_if(
+			[this]() -> bool { return !_cond(); }, std::move(rsmr));
+	}
+
+	void await_resume() {}
+
+private:
+	lockfree_list<resumer_i> &_waiters;
+	Cond &_cond;
+	resumer_i *_rsmr_out;
+};
+
+struct _coro_access {
+	template <typename T>
+	static coro_task<T> pop(chan<T> &ch) {
+		optional<T> val_opt;
+		auto cond = [&]() -> bool {
+			val_opt = ch._buf.pop();
+			return val_opt.has_value();
+		};
+		if (cond()) {
+#ifdef RUA_LOCK_PROF
+			ch._prof.record();
+#endif
+			co_return std::move(val_opt.value());
+		}
+#ifdef RUA_LOCK_PROF
+		auto t = tick();
+#endif
+		while (!val_opt) {
+			co_await _coro_waiter<decltype(cond)>(ch._waiters, cond);
+		}
+#ifdef RUA_LOCK_PROF
+		ch._prof.record(tick() - t);
+#endif
+		co_return std::move(val_opt.value());
+	}
+
+	static coro_task<void> lock(mutex &mtx) {
+		if (mtx.try_lock()) {
+			co_return;
+		}
+		++mtx._stats.contentions;
+#ifdef RUA_LOCK_PROF
+		auto t = tick();
+#endif
+		auto is_fifo = mtx._handoff == mutex_handoff::fifo;
+		resumer_i rsmr;
+		// In FIFO mode unlock() hands the lock to the popped waiter.
+		auto cond = [&]() -> bool {
+			return (is_fifo && rsmr &&
+					mtx._locked.load() ==
+						reinterpret_cast<uintptr_t>(rsmr.get())) ||
+				   mtx._try_lock();
+		};
+		for (;;) {
+			_coro_waiter<decltype(cond)> wtr(mtx._waiters, cond, &rsmr);
+			if (wtr.await_ready()) {
+				break;
+			}
+			co_await wtr;
+		}
+#ifdef RUA_LOCK_PROF
+		mtx._prof.record(tick() - t);
+#endif
+	}
+};
+
+template <typename T>
+inline coro_task<T> coro_pop(chan<T> &ch) {
+	return _coro_access::pop(ch);
+}
+
+inline coro_task<void> coro_lock(mutex &mtx) {
+	return _coro_access::lock(mtx);
+}
+
+class _coro_sleeper {
+public:
+	explicit _coro_sleeper(duration timeout) : _timeout(timeout) {}
+
+	bool await_ready() const {
+		return _timeout <= 0;
+	}
+
+	void await_suspend(std::coroutine_handle<> h) {
+		this_coro_executor().add_timer(tick() + _timeout, h);
+	}
+
+	void await_resume() {}
+
+private:
+	duration _timeout;
+};
+
+inline _coro_sleeper coro_sleep(duration timeout) {
+	return _coro_sleeper(timeout);
+}
+
+// Runs fn on a thread_pool and resumes the coroutine on its executor. The
+// awaiter lives in the coroutine frame, so nothing is allocated.
+template <typename Fn, typename Ret>
+class _coro_pool_awaiter {
+public:
+	_coro_pool_awaiter(thread_pool &pool, Fn &&fn) :
+		_pool(pool), _fn(std::move(fn)), _r(), _pstr(), _h() {}
+
+	bool await_ready() const {
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> h) {
+		_pstr.emplace(this_coro_executor().get_poster());
+		_h = h;
+		_pool.post(&_run, this);
+	}
+
+	Ret await_resume() {
+		return static_cast<Ret>(std::move(_r.value()));
+	}
+
+private:
+	thread_pool &_pool;
+	Fn _fn;
+	optional<conditional_t<std::is_void<Ret>::value, bool, Ret>> _r;
+	optional<coro_executor::poster> _pstr;
+	std::coroutine_handle<> _h;
+
+	static void _run(void *p) {
+		auto &awtr = *static_cast<_coro_pool_awaiter *>(p);
+		if constexpr (std::is_void<Ret>::value) {
+			awtr._fn();
+			awtr._r.emplace(true);
+		} else {
+			awtr._r.emplace(awtr._fn());
+		}
+		// The awaiter and the executor may be gone once the coroutine is
+		// resumed, so post through a local poster.
+		auto pstr = std::move(awtr._pstr.value());
+		pstr.post(awtr._h);
+	}
+};
+
+template <
+	typename Callee,
+	typename... Args,
+	typename Ret = decltype(std::declval<decay_t<Callee> &>()(
+		std::declval<decay_t<Args> &>()...))>
+inline auto coro_await(thread_pool &pool, Callee &&callee, Args &&...args) {
+	auto fn = [callee = std::forward<Callee>(callee),
+			   ... args = std::forward<Args>(args)]() mutable -> Ret {
+		return callee(args...);
+	};
+	return _coro_pool_awaiter<decltype(fn), Ret>(pool, std::move(fn));
+}
+
+// Blocking I/O runs on blocking_pool(), the buffers must stay alive until the
+// awaiter returns.
+
+inline auto coro_read(reader &r, bytes_ref p) {
+	return coro_await(blocking_pool(), [&r, p]() { return r.read(p); });
+}
+
+inline auto coro_write(writer &w, bytes_view p) {
+	return coro_await(blocking_pool(), [&w, p]() { return w.write(p); });
+}
+
+} // namespace rua
+
+#endif
+
+#endif
@@ -1,25 +1,42 @@
 #ifndef _RUA_FIBER_HPP
 #define _RUA_FIBER_HPP
 
+#include "any.hpp"
 #include "bytes.hpp"
 #include "chrono.hpp"
+#include "histogram.hpp"
 #include "sched.hpp"
 #include "sorted_list.hpp"
 #include "sync.hpp"
+#include "thread/var.hpp"
 #include "types/util.hpp"
 #include "ucontext.hpp"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cassert>
+#include <deque>
 #include <functional>
 #include <memory>
-#include <queue>
+#include <vector>
 
 namespace rua {
 
 class fiber_executor;
 
+template <typename T>
+class fiber_var;
+
+enum class fiber_priority : size_t { low = 0, normal, high, realtime };
+
+enum class fiber_sched_mode {
+	// First in, first out within each priority.
+	fifo,
+	// Earliest end time (the lifetime deadline) first within each priority.
+	edf
+};
+
 class fiber {
 public:
 	constexpr fiber() = default;
@@ -43,6 +60,21 @@ public:
 		_ctx->end_ti = now + dur;
 	}
 
+	fiber_priority priority() const {
+		if (!_ctx) {
+			return fiber_priority::normal;
+		}
+		return _ctx->prio;
+	}
+
+	// Takes effect the next time the fiber is queued.
+	void set_priority(fiber_priority prio) {
+		if (!_ctx) {
+			return;
+		}
+		_ctx->prio = prio;
+	}
+
 	void stop() {
 		if (!_ctx) {
 			return;
@@ -57,6 +89,8 @@ private:
 
 		std::atomic<bool> is_stoped;
 		time end_ti;
+		fiber_priority prio;
+		time queued_ti;
 
 		ucontext_t _uc;
 		int stk_ix;
@@ -64,6 +98,8 @@ private:
 
 		bool has_yielded;
 		std::shared_ptr<secondary_resumer> rsmr;
+
+		std::vector<any> vars;
 	};
 
 	std::shared_ptr<_ctx_t> _ctx;
@@ -71,19 +107,51 @@ private:
 	fiber(std::shared_ptr<_ctx_t> ctx) : _ctx(std::move(ctx)) {}
 
 	friend fiber_executor;
+
+	template <typename T>
+	friend class fiber_var;
+};
+
+// Counters are updated by the executor's thread and may be polled from any
+// thread. The histograms are only filled after enable_stats_timing().
+struct fiber_executor_stats {
+	std::atomic<size_t> queued, sleeping, waiting;
+	std::atomic<uint64_t> switches, copied_bytes;
+
+	// Nanoseconds from being queued to running.
+	histogram run_queue_wait;
+
+	// Nanoseconds from a fiber suspending to the next fiber running.
+	histogram switch_cost;
+
+	histogram copied_bytes_per_switch;
+
+	fiber_executor_stats() :
+		queued(0), sleeping(0), waiting(0), switches(0), copied_bytes(0) {}
 };
 
 class fiber_executor {
 public:
-	fiber_executor(size_t stack_size = 0x100000) :
-		_stk_sz(stack_size), _stk_ix(0), _spdr(*this) {}
-
-	fiber execute(std::function<void()> task, duration lifetime = 0) {
+	fiber_executor(
+		size_t stack_size = 0x100000,
+		fiber_sched_mode mode = fiber_sched_mode::fifo) :
+		_exs(mode),
+		_stats_timing(false),
+		_sw_copied(0),
+		_stk_sz(stack_size),
+		_stk_ix(0),
+		_spdr(*this) {}
+
+	fiber execute(
+		std::function<void()> task,
+		duration lifetime = 0,
+		fiber_priority prio = fiber_priority::normal) {
 		fiber fbr(std::make_shared<fiber::_ctx_t>());
 		fbr._ctx->tsk = std::move(task);
 		fbr._ctx->is_stoped.store(false);
+		fbr._ctx->prio = prio;
 		fbr.reset_lifetime(lifetime);
-		_exs.emplace(fbr);
+		_enqueue(fbr);
 		return fbr;
 	}
 
@@ -91,6 +159,24 @@ public:
 		return _cur;
 	}
 
+	// Fibers that reach preempt_point() after running longer than the time
+	// slice are requeued. Must be called on the thread that runs the executor.
+	void enable_preemption(duration time_slice) {
+		_pt.reset(new preempt_timer(time_slice));
+	}
+
+	void disable_preemption() {
+		_pt.reset();
+	}
+
+	const fiber_executor_stats &stats() const {
+		return _stats;
+	}
+
+	void enable_stats_timing(bool enabled = true) {
+		_stats_timing = enabled;
+	}
+
 	operator bool() const {
 		return _exs.size() || _spds.size() || _cws.size();
 	}
@@ -211,9 +297,13 @@ public:
 			_fe->_cur._ctx->has_yielded = true;
 			_fe->_cur._ctx->stk_ix = _fe->_stk_ix;
 			sl.emplace(resume_ti, _fe->_cur);
+			_fe->_update_gauges();
 
 			_fe->_prev = std::move(_fe->_cur);
 			if (_fe->_exs.size()) {
+				if (_fe->_stats_timing) {
+					_fe->_sw_begin_ti = tick();
+				}
 				if (!_fe->_try_resume_exs_front()) {
 					_fe->_swap_new_runner_uc(&_fe->_prev._ctx->_uc);
 				}
@@ -221,6 +311,7 @@ public:
 				swap_ucontext(&_fe->_prev._ctx->_uc, &_fe->_orig_uc);
 			}
 			_fe->_clear_prev();
+			_fe->_on_switched();
 		}
 
 		virtual void sleep(duration timeout) {
@@ -240,7 +331,7 @@ public:
 
 			auto &rsmr = _fe->_cur._ctx->rsmr;
 			if (rsmr) {
-				rsmr.reset();
+				rsmr->reset();
 			} else {
 				rsmr = std::make_shared<secondary_resumer>(_fe->_orig_rsmr);
 			}
@@ -264,7 +355,68 @@ public:
 	}
 
 private:
-	std::queue<fiber> _exs;
+	class _run_queue_t {
+	public:
+		explicit _run_queue_t(fiber_sched_mode mode) : _mode(mode), _sz(0) {}
+
+		size_t size() const {
+			return _sz;
+		}
+
+		bool empty() const {
+			return !_sz;
+		}
+
+		void emplace(fiber fbr) {
+			assert(fbr._ctx);
+
+			auto &q = _qs[static_cast<size_t>(fbr._ctx->prio)];
+			++_sz;
+
+			if (_mode == fiber_sched_mode::fifo) {
+				q.emplace_back(std::move(fbr));
+				return;
+			}
+			auto it = q.end();
+			while (it != q.begin()) {
+				auto before = it - 1;
+				if (before->_ctx && before->_ctx->end_ti <= fbr._ctx->end_ti) {
+					break;
+				}
+				it = before;
+			}
+			q.emplace(it, std::move(fbr));
+		}
+
+		fiber &front() {
+			return _front_q().front();
+		}
+
+		void pop() {
+			_front_q().pop_front();
+			--_sz;
+		}
+
+	private:
+		fiber_sched_mode _mode;
+		size_t _sz;
+		std::array<
+			std::deque<fiber>,
+			static_cast<size_t>(fiber_priority::realtime) + 1>
+			_qs;
+
+		std::deque<fiber> &_front_q() {
+			assert(_sz);
+
+			auto i = _qs.size() - 1;
+			while (i && _qs[i].empty()) {
+				--i;
+			}
+			return _qs[i];
+		}
+	};
+
+	_run_queue_t _exs;
 	fiber _cur, _prev;
 
 	struct _suspending_t {
@@ -283,19 +435,72 @@ private:
 			if (now < it->resume_ti) {
 				break;
 			}
-			_exs.emplace(std::move(it->fbr));
+			_enqueue(std::move(it->fbr));
 		}
+		_update_gauges();
 	}
 
 	void _check_cws(time now) {
 		for (auto it = _cws.begin(); it != _cws.end();) {
 			if (it->fbr._ctx->rsmr->state() || now >= it->resume_ti) {
-				_exs.emplace(std::move(it->fbr));
+				_enqueue(std::move(it->fbr));
 				it = _cws.erase(it);
 				continue;
 			}
 			++it;
 		}
+		_update_gauges();
+	}
+
+	fiber_executor_stats _stats;
+	bool _stats_timing;
+	time _sw_begin_ti;
+	size_t _sw_copied;
+
+	void _update_gauges() {
+		_stats.queued.store(_exs.size(), std::memory_order_relaxed);
+		_stats.sleeping.store(_spds.size(), std::memory_order_relaxed);
+		_stats.waiting.store(_cws.size(), std::memory_order_relaxed);
+	}
+
+	void _enqueue(fiber fbr) {
+		if (_stats_timing) {
+			fbr._ctx->queued_ti = tick();
+		}
+		_exs.emplace(std::move(fbr));
+		_stats.queued.store(_exs.size(), std::memory_order_relaxed);
+	}
+
+	void _dequeue_to_cur() {
+		_cur = std::move(_exs.front());
+		_exs.pop();
+		_stats.queued.store(_exs.size(), std::memory_order_relaxed);
+
+		if (_stats_timing && _cur._ctx->queued_ti) {
+			_stats.run_queue_wait.record(static_cast<uint64_t>(
+				(tick() - _cur._ctx->queued_ti).nanoseconds()));
+			_cur._ctx->queued_ti.reset();
+		}
+	}
+
+	void _on_copied(size_t n) {
+		_sw_copied += n;
+		_stats.copied_bytes.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	void _on_switched() {
+		_stats.switches.fetch_add(1, std::memory_order_relaxed);
+		if (!_stats_timing) {
+			_sw_copied = 0;
+			return;
+		}
+		_stats.copied_bytes_per_switch.record(_sw_copied);
+		_sw_copied = 0;
+		if (_sw_begin_ti) {
+			_stats.switch_cost.record(
+				static_cast<uint64_t>((tick() - _sw_begin_ti).nanoseconds()));
+			_sw_begin_ti.reset();
+		}
 	}
 
 	ucontext_t _orig_uc;
@@ -326,6 +531,7 @@ private:
 		auto rmdr = stk_used.size() % 1024;
 		_prev._ctx->stk_bak.resize(stk_used.size() + (rmdr ? 1024 - rmdr : 0));
 		_prev._ctx->stk_bak = stk_used;
+		_on_copied(stk_used.size());
 
 		_prev._ctx.reset();
 	}
@@ -344,15 +550,19 @@ private:
 			return true;
 		}
 
-		_cur = std::move(_exs.front());
-		_exs.pop();
+		_dequeue_to_cur();
 
 		_stk_ix = _cur._ctx->stk_ix;
 		auto &cur_stk = _cur_stk();
 		cur_stk(cur_stk.size() - _cur._ctx->stk_bak.size())
 			.copy_from(_cur._ctx->stk_bak);
+		_on_copied(_cur._ctx->stk_bak.size());
 		_cur._ctx->stk_bak.resize(0);
 
+		if (_pt) {
+			_pt->reset();
+		}
+
 		if (!oucp) {
 			set_ucontext(&_cur._ctx->_uc);
 			return true;
@@ -368,28 +578,36 @@ private:
 			assert(_exs.front()._ctx);
 			_try_resume_exs_front();
 
-			_cur = std::move(_exs.front());
-			assert(!_exs.front()._ctx);
-			_exs.pop();
+			_dequeue_to_cur();
 
 			if (_cur._ctx->is_stoped.load()) {
+				_end_cur();
 				continue;
 			}
 
+			_on_switched();
+
 			for (;;) {
+				if (_pt) {
+					_pt->reset();
+				}
+
 				_cur._ctx->tsk();
 
 				if (_cur._ctx->is_stoped.load()) {
+					_end_cur();
 					break;
 				}
 
 				if (_cur._ctx->end_ti <= tick()) {
 					_cur._ctx->is_stoped.store(false);
+					_end_cur();
 					break;
 				}
 
 				if (!_cur._ctx->has_yielded) {
 					_spds.emplace(time_zero(), std::move(_cur));
+					_update_gauges();
 					break;
 				}
 				_cur._ctx->has_yielded = false;
@@ -399,6 +617,11 @@ private:
 		set_ucontext(&_orig_uc);
 	}
 
+	void _end_cur() {
+		_cur._ctx->vars.clear();
+		_cur._ctx->tsk = nullptr;
+	}
+
 	static void _runner(any_word th1s) {
 		th1s.as<fiber_executor *>()->_run();
 	}
@@ -417,18 +640,31 @@ private:
 	}
 
 	void _switch_to_runner_uc() {
+		if (_pt) {
+			_pt->start();
+			_this_preempt_timer() = _pt.get();
+		}
 		while (_exs.size()) {
 			if (!_try_resume_exs_front(&_orig_uc)) {
 				_swap_new_runner_uc(&_orig_uc);
 			}
 			_clear_prev();
 		}
+		if (_pt) {
+			_pt->stop();
+			_this_preempt_timer() = nullptr;
+		}
 	}
 
 	friend suspender;
 	suspender _spdr;
 
 	resumer_i _orig_rsmr;
+
+	std::unique_ptr<preempt_timer> _pt;
+
+	template <typename T>
+	friend class fiber_var;
 };
 
 inline fiber_executor *this_fiber_executor() {
@@ -451,17 +687,275 @@ inline fiber this_fiber() {
 	return fiber();
 }
 
-inline fiber co(std::function<void()> task, duration lifetime = 0) {
+inline _thread_var_indexer &_fiber_var_indexer() {
+	static _thread_var_indexer inst;
+	return inst;
+}
+
+template <typename T>
+class fiber_var {
+public:
+	fiber_var() : _ix(_fiber_var_indexer().alloc()) {}
+
+	~fiber_var() {
+		if (!is_storable()) {
+			return;
+		}
+		_fiber_var_indexer().dealloc(_ix);
+		_ix = static_cast<size_t>(-1);
+	}
+
+	fiber_var(fiber_var &&src) : _ix(src._ix) {
+		if (src.is_storable()) {
+			src._ix = static_cast<size_t>(-1);
+		}
+	}
+
+	RUA_OVERLOAD_ASSIGNMENT_R(fiber_var)
+
+	bool is_storable() const {
+		return _ix != static_cast<size_t>(-1);
+	}
+
+	bool has_value() const {
+		auto ctx = _ctx();
+		if (!ctx) {
+			return false;
+		}
+		auto &li = ctx->vars;
+		if (li.size() <= _ix) {
+			return false;
+		}
+		return li[_ix].template type_is<T>();
+	}
+
+	template <typename... Args>
+	T &emplace(Args &&...args) {
+		RUA_SPASSERT((std::is_constructible<T, Args...>::value));
+
+		auto ctx = _ctx();
+		assert(ctx);
+
+		auto &li = ctx->vars;
+		if (li.size() <= _ix) {
+			li.resize(_ix + 1);
+		}
+		return li[_ix].template emplace<T>(std::forward<Args>(args)...);
+	}
+
+	T &value() const {
+		auto ctx = _ctx();
+		assert(ctx);
+		assert(ctx->vars.size() > _ix);
+
+		return ctx->vars[_ix].template as<T>();
+	}
+
+	void reset() {
+		auto ctx = _ctx();
+		if (!ctx) {
+			return;
+		}
+		auto &li = ctx->vars;
+		if (li.size() <= _ix) {
+			return;
+		}
+		li[_ix].reset();
+	}
+
+private:
+	size_t _ix;
+
+	static fiber::_ctx_t *_ctx() {
+		auto fe = this_fiber_executor();
+		if (!fe) {
+			return nullptr;
+		}
+		return fe->_cur._ctx.get();
+	}
+};
+
+inline fiber co(
+	std::function<void()> task,
+	duration lifetime = 0,
+	fiber_priority prio = fiber_priority::normal) {
 	auto fe = this_fiber_executor();
 	if (fe) {
-		return fe->execute(std::move(task), lifetime);
+		return fe->execute(std::move(task), lifetime, prio);
 	}
 	auto tmp_fe = std::make_shared<fiber_executor>();
-	tmp_fe->execute(std::move(task), lifetime);
+	tmp_fe->execute(std::move(task), lifetime, prio);
 	tmp_fe->run();
 	return fiber();
 }
 
+class fiber_group {
+public:
+	fiber_group() : fiber_group(this_fiber_executor()) {}
+
+	explicit fiber_group(fiber_executor *fe) :
+		_fe(fe), _st(std::make_shared<_state_t>()), _joined(0) {}
+
+	explicit fiber_group(fiber_executor &fe) : fiber_group(&fe) {}
+
+	fiber_group(const fiber_group &) = delete;
+
+	fiber_group &operator=(const fiber_group &) = delete;
+
+	// The future is left without a value if the fiber is stopped before the
+	// task returns.
+	template <
+		typename Callee,
+		typename Ret = decltype(std::declval<Callee &&>()())>
+	future<Ret>
+	spawn(Callee &&task, fiber_priority prio = fiber_priority::normal) {
+		auto mbr = std::make_shared<_member_t<Ret>>(_st);
+		auto fut = mbr->prm.get_future();
+		std::weak_ptr<void> mbr_ref(mbr);
+		std::function<void()> tsk(
+			[mbr, task]() mutable { _invoke(mbr->prm, task); });
+		mbr.reset();
+
+		auto fbr = _fe ? _fe->execute(std::move(tsk), 0, prio)
+					   : co(std::move(tsk), 0, prio);
+		if (_st->is_canceled.load()) {
+			fbr.stop();
+		}
+		// Pruning only before a reallocation keeps spawn() amortized O(1).
+		if (_fbrs.size() == _fbrs.capacity()) {
+			_prune();
+		}
+		_fbrs.emplace_back(std::move(fbr), std::move(mbr_ref));
+		return fut;
+	}
+
+	// Number of spawned fibers, finished ones included.
+	size_t size() const {
+		return _st->pending.load() + _st->done.load();
+	}
+
+	size_t pending() const {
+		return _st->pending.load();
+	}
+
+	bool join_all(duration timeout = duration_max()) {
+		return join_all(this_suspender(), timeout);
+	}
+
+	bool join_all(suspender_i spdr, duration timeout = duration_max()) {
+		auto st = _st.get();
+		if (!_wait_until(
+				st->waiters,
+				[st]() -> bool { return !st->pending.load(); },
+				std::move(spdr),
+				timeout)) {
+			return false;
+		}
+		_joined = st->done.load();
+		_prune();
+		return true;
+	}
+
+	// Returns true once for every finished fiber, in order of completion.
+	bool join_any(duration timeout = duration_max()) {
+		return join_any(this_suspender(), timeout);
+	}
+
+	bool join_any(suspender_i spdr, duration timeout = duration_max()) {
+		auto st = _st.get();
+		auto joined = _joined;
+		if (st->done.load() == joined && !st->pending.load()) {
+			return false;
+		}
+		if (!_wait_until(
+				st->waiters,
+				[st, joined]() -> bool { return st->done.load() > joined; },
+				std::move(spdr),
+				timeout)) {
+			return false;
+		}
+		++_joined;
+		return true;
+	}
+
+	// Stops every fiber of the group, running tasks can observe it through
+	// this_fiber().
+	void cancel() {
+		_st->is_canceled.store(true);
+		for (auto &ref : _fbrs) {
+			ref.fbr.stop();
+		}
+	}
+
+	bool is_canceled() const {
+		return _st->is_canceled.load();
+	}
+
+private:
+	struct _state_t {
+		std::atomic<size_t> pending, done;
+		std::atomic<bool> is_canceled;
+		lockfree_list<resumer_i> waiters;
+
+		_state_t() : pending(0), done(0), is_canceled(false), waiters() {}
+	};
+
+	template <typename Ret>
+	struct _member_t {
+		promise<Ret> prm;
+		std::shared_ptr<_state_t> grp;
+
+		explicit _member_t(std::shared_ptr<_state_t> g) :
+			prm(), grp(std::move(g)) {
+			++grp->pending;
+		}
+
+		~_member_t() {
+			prm.reset();
+			++grp->done;
+			--grp->pending;
+			_resume_all(grp->waiters);
+		}
+	};
+
+	// The task owns its member, which expires when the fiber is finished or
+	// stopped.
+	struct _fiber_ref_t {
+		fiber fbr;
+		std::weak_ptr<void> mbr;
+
+		_fiber_ref_t(fiber f, std::weak_ptr<void> m) :
+			fbr(std::move(f)), mbr(std::move(m)) {}
+	};
+
+	fiber_executor *_fe;
+	std::shared_ptr<_state_t> _st;
+	std::vector<_fiber_ref_t> _fbrs;
+	size_t _joined;
+
+	void _prune() {
+		_fbrs.erase(
+			std::remove_if(
+				_fbrs.begin(),
+				_fbrs.end(),
+				[](const _fiber_ref_t &ref) -> bool {
+					return ref.mbr.expired();
+				}),
+			_fbrs.end());
+	}
+
+	template <typename Callee>
+	static void _invoke(promise<void> &prm, Callee &task) {
+		task();
+		prm.set_value();
+	}
+
+	template <typename Ret, typename Callee>
+	static void _invoke(promise<Ret> &prm, Callee &task) {
+		prm.set_value(task());
+	}
+};
+
 } // namespace rua
 
 #endif
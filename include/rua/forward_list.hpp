@@ -2,6 +2,7 @@
 #define _RUA_FORWARD_LIST_HPP
 
 #include "macros.hpp"
+#include "node_pool.hpp"
 #include "types/util.hpp"
 
 #include <cassert>
@@ -17,6 +18,14 @@ public:
 
 		template <typename... Args>
 		node_t(Args &&... args) : value(std::forward<Args>(args)...) {}
+
+		static void *operator new(size_t) {
+			return node_pool<sizeof(node_t), alignof(node_t)>::alloc();
+		}
+
+		static void operator delete(void *ptr) {
+			node_pool<sizeof(node_t), alignof(node_t)>::free(ptr);
+		}
 	};
 
 	class const_iterator {
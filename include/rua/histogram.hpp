@@ -0,0 +1,135 @@
+#ifndef _RUA_HISTOGRAM_HPP
+#define _RUA_HISTOGRAM_HPP
+
+#include "macros.hpp"
+#include "types/util.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace rua {
+
+// Log-linear buckets in the style of HDR histograms, every power of two is
+// split into 16 linear sub-buckets, so values are kept with a relative error
+// below 1/16. All counters are atomic and may be read from any thread.
+class histogram {
+public:
+	histogram() : _c(0), _sum(0), _max(0) {
+		for (auto &bkt : _bkts) {
+			bkt.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	histogram(const histogram &) = delete;
+
+	histogram &operator=(const histogram &) = delete;
+
+	void record(uint64_t val) {
+		_bkts[_index(val)].fetch_add(1, std::memory_order_relaxed);
+		_c.fetch_add(1, std::memory_order_relaxed);
+		_sum.fetch_add(val, std::memory_order_relaxed);
+
+		auto old_max = _max.load(std::memory_order_relaxed);
+		while (old_max < val && !_max.compare_exchange_weak(
+									old_max, val, std::memory_order_relaxed))
+			;
+	}
+
+	uint64_t count() const {
+		return _c.load(std::memory_order_relaxed);
+	}
+
+	uint64_t sum() const {
+		return _sum.load(std::memory_order_relaxed);
+	}
+
+	uint64_t max() const {
+		return _max.load(std::memory_order_relaxed);
+	}
+
+	uint64_t mean() const {
+		auto c = count();
+		return c ? sum() / c : 0;
+	}
+
+	// Upper bound of the bucket holding the given percentile (0 to 100).
+	uint64_t percentile(double pct) const {
+		uint64_t total = 0;
+		for (auto &bkt : _bkts) {
+			total += bkt.load(std::memory_order_relaxed);
+		}
+		if (!total) {
+			return 0;
+		}
+
+		auto rank =
+			static_cast<uint64_t>(static_cast<double>(total) * pct / 100);
+		if (rank < 1) {
+			rank = 1;
+		} else if (rank > total) {
+			rank = total;
+		}
+
+		uint64_t c = 0;
+		for (size_t i = 0; i < _bkt_c; ++i) {
+			c += _bkts[i].load(std::memory_order_relaxed);
+			if (c >= rank) {
+				auto mx = max();
+				auto upper = _upper(i);
+				return upper < mx ? upper : mx;
+			}
+		}
+		return max();
+	}
+
+	void reset() {
+		for (auto &bkt : _bkts) {
+			bkt.store(0, std::memory_order_relaxed);
+		}
+		_c.store(0, std::memory_order_relaxed);
+		_sum.store(0, std::memory_order_relaxed);
+		_max.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	static constexpr size_t _sub_bits = 4;
+	static constexpr uint64_t _sub_c = 1 << _sub_bits;
+	static constexpr size_t _bkt_c = (64 - _sub_bits + 1) * _sub_c;
+
+	std::atomic<uint64_t> _bkts[_bkt_c];
+	std::atomic<uint64_t> _c, _sum, _max;
+
+	static size_t _msb(uint64_t val) {
+		size_t r = 0;
+		for (size_t sh = 32; sh; sh >>= 1) {
+			if (val >> sh) {
+				val >>= sh;
+				r += sh;
+			}
+		}
+		return r;
+	}
+
+	static size_t _index(uint64_t val) {
+		if (val < _sub_c) {
+			return static_cast<size_t>(val);
+		}
+		auto sh = _msb(val) - _sub_bits;
+		return static_cast<size_t>(
+			(sh + 1) * _sub_c + ((val >> sh) & (_sub_c - 1)));
+	}
+
+	static uint64_t _upper(size_t ix) {
+		auto grp = ix / _sub_c;
+		if (!grp) {
+			return ix;
+		}
+		auto sh = grp - 1;
+		auto lower = (_sub_c + ix % _sub_c) << sh;
+		return lower + ((static_cast<uint64_t>(1) << sh) - 1);
+	}
+};
+
+} // namespace rua
+
+#endif
@@ -15,7 +15,8 @@ namespace rua {
 
 class read_group : public reader {
 public:
-	constexpr read_group(size_t buf_sz = 1024) : _c(0), _buf_sz(buf_sz) {}
+	constexpr read_group(size_t buf_sz = 1024) :
+		_c(0), _buf_sz(buf_sz), _ch("rua::read_group") {}
 
 	void add(reader_i r) {
 		++_c;
@@ -68,7 +68,7 @@ inline printer &err_log_printer() {
 }
 
 inline mutex &log_mutex() {
-	static mutex mtx;
+	static mutex mtx("rua::log_mutex");
 	return mtx;
 }
 
@@ -93,7 +93,7 @@ inline void err_log(Args &&...args) {
 }
 
 inline chan<std::function<void()>> &log_chan() {
-	static chan<std::function<void()>> ch;
+	static chan<std::function<void()>> ch("rua::log_chan");
 	static thread log_td([]() {
 		for (;;) {
 			ch.pop()();
@@ -128,6 +128,25 @@ inline void post_err_log(Args &&...args) {
 	};
 }
 
+#ifdef RUA_LOCK_PROF
+
+// Logs lock_prof_report(), wait times are in microseconds.
+inline void log_lock_prof_report() {
+	for (auto &st : lock_prof_report()) {
+		log(st.name,
+			"acquisitions:",
+			st.acquisitions,
+			"contended:",
+			st.contended_acquisitions,
+			"total_wait:",
+			st.total_wait.microseconds(),
+			"max_wait:",
+			st.max_wait.microseconds());
+	}
+}
+
+#endif
+
 } // namespace rua
 
 #endif
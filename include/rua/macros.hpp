@@ -109,6 +109,11 @@
 #define RUA_SPASSERT(cond) assert(cond)
 #endif
 
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902 &&       \
+	RUA_HAS_INC(<coroutine>)
+#define RUA_COROUTINE_SUPPORTED
+#endif
+
 #ifdef __has_cpp_attribute
 #if __has_cpp_attribute(fallthrough)
 #define RUA_FALLTHROUGH [[fallthrough]]
@@ -125,6 +130,20 @@
 #define RUA_FALLTHROUGH
 #endif
 
+#ifdef __has_cpp_attribute
+#if __has_cpp_attribute(maybe_unused) && RUA_CPP >= RUA_CPP_17
+#define RUA_MAYBE_UNUSED [[maybe_unused]]
+#elif __has_cpp_attribute(gnu::unused)
+#define RUA_MAYBE_UNUSED [[gnu::unused]]
+#else
+#define RUA_MAYBE_UNUSED
+#endif
+#elif RUA_CPP >= RUA_CPP_17
+#define RUA_MAYBE_UNUSED [[maybe_unused]]
+#else
+#define RUA_MAYBE_UNUSED
+#endif
+
 #if defined(__unix__) || defined(unix) || defined(__unix) ||                   \
 	defined(_XOPEN_SOURCE) || defined(_POSIX_SOURCE) ||                        \
 	(defined(__APPLE__) && defined(__MACH__))
@@ -184,6 +203,10 @@
 
 #endif
 
+#ifndef RUA_CACHE_LINE_SIZE
+#define RUA_CACHE_LINE_SIZE 64
+#endif
+
 #define RUA_ONCE_CODE(code_block)                                              \
 	{                                                                          \
 		static std::once_flag flg;                                             \
@@ -0,0 +1,190 @@
+#ifndef _RUA_NODE_POOL_HPP
+#define _RUA_NODE_POOL_HPP
+
+#include "macros.hpp"
+#include "types/util.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace rua {
+
+// Free blocks of one size are cached per thread, when a cache grows too large
+// a batch of blocks moves to a global lock-free list, where threads that only
+// allocate (such as the producer of a channel) refill from.
+//
+// Only nodes are pooled. Hazard pointer scans reuse per-thread buffers and
+// thread resumers are made once per suspender, but other resumers (such as the
+// ones of coroutines) are still allocated per wait.
+//
+// Blocks aligned beyond the default of the global operator new are not pooled,
+// they are allocated by the aligned operator new.
+//
+// Define RUA_NO_NODE_POOL to allocate every node by the global operator new,
+// and RUA_NO_NODE_POOL_GLOBAL to keep blocks in their thread caches only.
+template <size_t Size, size_t Align = alignof(std::max_align_t)>
+class node_pool {
+public:
+	static void *alloc() {
+#ifdef __cpp_aligned_new
+		if (Align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+			return ::operator new(Size, std::align_val_t(Align));
+		}
+#endif
+#ifndef RUA_NO_NODE_POOL
+		auto cc = _this_cache();
+		if (cc) {
+			if (!cc->front) {
+				_refill(*cc);
+			}
+			if (cc->front) {
+				auto blk = cc->front;
+				cc->front = blk->next;
+				--cc->c;
+				return blk;
+			}
+		}
+#endif
+		return ::operator new(_blk_sz);
+	}
+
+	static void free(void *ptr) {
+#ifdef __cpp_aligned_new
+		if (Align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+			::operator delete(ptr, std::align_val_t(Align));
+			return;
+		}
+#endif
+#ifndef RUA_NO_NODE_POOL
+		auto cc = _this_cache();
+		if (cc) {
+			auto blk = static_cast<_blk_t *>(ptr);
+			blk->next = cc->front;
+			cc->front = blk;
+			if (++cc->c >= _batch_sz * 2) {
+				_spill(*cc, _batch_sz);
+			}
+			return;
+		}
+#endif
+		::operator delete(ptr);
+	}
+
+private:
+#ifndef __cpp_aligned_new
+	RUA_SASSERT(Align <= alignof(std::max_align_t));
+#endif
+
+	struct _blk_t {
+		_blk_t *next;
+		_blk_t *next_batch;
+	};
+
+	static constexpr size_t _blk_sz =
+		Size < sizeof(_blk_t) ? sizeof(_blk_t) : Size;
+
+	static constexpr size_t _batch_sz = 64;
+
+	// Trivially destructible, so it is still readable while other thread
+	// locals are being destroyed.
+	struct _cache_t {
+		_blk_t *front;
+		size_t c;
+		bool is_registered, is_closed;
+	};
+
+	class _cache_closer {
+	public:
+		~_cache_closer() {
+			auto &cc = _cache();
+			while (cc.c) {
+				_spill(cc, _batch_sz);
+			}
+			cc.is_closed = true;
+		}
+	};
+
+	static _cache_t &_cache() {
+		static thread_local _cache_t cc;
+		return cc;
+	}
+
+	static _cache_t *_this_cache() {
+		auto &cc = _cache();
+		if (cc.is_closed) {
+			return nullptr;
+		}
+		if (!cc.is_registered) {
+			cc.is_registered = true;
+			static thread_local _cache_closer closer;
+			(void)closer;
+		}
+		return &cc;
+	}
+
+	static std::atomic<_blk_t *> &_global() {
+		static std::atomic<_blk_t *> front(nullptr);
+		return front;
+	}
+
+	static void _spill(_cache_t &cc, size_t n) {
+		auto front = cc.front;
+		auto back = front;
+		size_t c = 1;
+		for (; c < n && back->next; ++c) {
+			back = back->next;
+		}
+		cc.front = back->next;
+		cc.c -= c;
+		back->next = nullptr;
+
+#ifdef RUA_NO_NODE_POOL_GLOBAL
+		while (front) {
+			auto blk = front;
+			front = front->next;
+			::operator delete(blk);
+		}
+#else
+		auto &glb = _global();
+		front->next_batch = glb.load();
+		while (!glb.compare_exchange_weak(front->next_batch, front))
+			;
+#endif
+	}
+
+	static void _refill(_cache_t &cc) {
+#ifndef RUA_NO_NODE_POOL_GLOBAL
+		auto &glb = _global();
+		if (!glb.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		// Taking the whole list avoids the ABA problem of popping one batch.
+		auto batch = glb.exchange(nullptr);
+		if (!batch) {
+			return;
+		}
+		auto rest = batch->next_batch;
+		if (rest) {
+			auto rest_back = rest;
+			while (rest_back->next_batch) {
+				rest_back = rest_back->next_batch;
+			}
+			rest_back->next_batch = glb.load();
+			while (!glb.compare_exchange_weak(rest_back->next_batch, rest))
+				;
+		}
+
+		cc.front = batch;
+		cc.c = 0;
+		for (auto blk = batch; blk; blk = blk->next) {
+			++cc.c;
+		}
+#endif
+	}
+};
+
+} // namespace rua
+
+#endif
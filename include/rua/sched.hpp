@@ -3,6 +3,8 @@
 
 #include "sched/async.hpp"
 #include "sched/await.hpp"
+#include "sched/preempt.hpp"
 #include "sched/suspender.hpp"
+#include "sched/thread_pool.hpp"
 
 #endif
@@ -1,25 +1,54 @@
 #ifndef _RUA_SCHED_ASYNC_UNI_HPP
 #define _RUA_SCHED_ASYNC_UNI_HPP
 
-#include "../../thread/basic.hpp"
+#include "../thread_pool.hpp"
 
-#include "../../sync/chan.hpp"
+#include "../../chrono/duration.hpp"
+#include "../../sync/future.hpp"
 #include "../../types/util.hpp"
 
 #include <functional>
 
 namespace rua {
 
+// Short CPU-bound tasks, run by async(). Changes take effect only before the
+// first use of the pool.
+inline thread_pool_options &cpu_pool_config() {
+	static thread_pool_options opts{
+		0, thread_pool::cpu_count(), seconds(60)};
+	return opts;
+}
+
+// Blocking system calls, run by await(). Changes take effect only before the
+// first use of the pool.
+inline thread_pool_options &blocking_pool_config() {
+	static thread_pool_options opts{
+		0, thread_pool::default_max_worker_count(), seconds(60)};
+	return opts;
+}
+
+// The pools are never destroyed, tasks may still be posted while statics are
+// destroyed.
+
+inline thread_pool &cpu_pool() {
+	static auto &pool = *new thread_pool(cpu_pool_config());
+	return pool;
+}
+
+inline thread_pool &blocking_pool() {
+	static auto &pool = *new thread_pool(blocking_pool_config());
+	return pool;
+}
+
 inline void async(std::function<void()> task) {
-	static chan<std::function<void()>> que;
-	if (que.emplace(std::move(task))) {
-		return;
-	}
-	thread([]() {
-		for (;;) {
-			que.pop()();
-		}
-	});
+	cpu_pool().post(std::move(task));
+}
+
+template <
+	typename Callee,
+	typename Ret = decltype(std::declval<decay_t<Callee> &>()())>
+inline future<Ret> async_submit(Callee &&callee) {
+	return cpu_pool().submit(std::forward<Callee>(callee));
 }
 
 } // namespace rua
@@ -4,14 +4,68 @@
 #include "../async/uni.hpp"
 #include "../suspender.hpp"
 
+#include "../../node_pool.hpp"
+#include "../../optional.hpp"
 #include "../../sched/suspender.hpp"
-#include "../../sync/chan.hpp"
 #include "../../types/util.hpp"
 
+#include <atomic>
+#include <cassert>
 #include <memory>
 
 namespace rua {
 
+// Runs fn on the async pool and suspends until it returns. Fibers swap their
+// shared stacks out while suspended, so fn and the completion slot live in a
+// pooled object instead of the waiting stack.
+template <typename Fn, typename Ret>
+class _await_slot {
+public:
+	_await_slot(Fn &&fn, resumer_i rsmr) :
+		_fn(std::move(fn)), _r(), _rsmr(std::move(rsmr)), _is_done(false) {}
+
+	static void *operator new(size_t) {
+		return node_pool<sizeof(_await_slot), alignof(_await_slot)>::alloc();
+	}
+
+	static void operator delete(void *ptr) {
+		node_pool<sizeof(_await_slot), alignof(_await_slot)>::free(ptr);
+	}
+
+	Ret wait(const suspender_i &spdr) {
+		while (!_is_done.load()) {
+			spdr->suspend(duration_max());
+		}
+		return std::move(_r.value());
+	}
+
+	static void run(void *p) {
+		auto &slot = *static_cast<_await_slot *>(p);
+		slot._r.emplace(slot._fn());
+		// The waiter may free the slot once it sees _is_done.
+		auto rsmr = std::move(slot._rsmr);
+		slot._is_done.store(true);
+		rsmr->resume();
+	}
+
+private:
+	Fn _fn;
+	optional<Ret> _r;
+	resumer_i _rsmr;
+	std::atomic<bool> _is_done;
+};
+
+template <typename Fn, typename Ret = decltype(std::declval<Fn &>()())>
+inline Ret _await_on_pool(thread_pool &pool, suspender_i spdr, Fn fn) {
+	std::unique_ptr<_await_slot<Fn, Ret>> slot(
+		new _await_slot<Fn, Ret>(std::move(fn), spdr->get_resumer()));
+	pool.post(&_await_slot<Fn, Ret>::run, slot.get());
+	return slot->wait(spdr);
+}
+
+// Runs callee on pool, which is blocking_pool() by default, and suspends the
+// caller until it returns. On a thread_suspender the callee runs inline.
+
 template <
 	typename Callee,
 	typename... Args,
@@ -21,19 +75,18 @@ inline enable_if_t<
 	!std::is_function<remove_reference_t<Callee>>::value &&
 		std::is_same<Ret, void>::value,
 	Ret>
-await(suspender_i spdr, Callee &&callee, Args &&...args) {
+await(
+	thread_pool &pool, suspender_i spdr, Callee &&callee, Args &&...args) {
 	assert(spdr);
 
 	if (spdr.type_is<thread_suspender>()) {
 		return std::forward<Callee>(callee)(std::forward<Args>(args)...);
 	}
-	auto ch_ptr = new chan<bool>;
-	std::unique_ptr<chan<bool>> ch_uptr(ch_ptr);
-	async([=]() mutable {
-		callee(args...);
-		*ch_ptr << true;
-	});
-	ch_ptr->pop(std::move(spdr));
+	_await_on_pool(
+		pool, std::move(spdr), [callee, args...]() mutable -> bool {
+			callee(args...);
+			return true;
+		});
 }
 
 template <
@@ -45,16 +98,40 @@ inline enable_if_t<
 	!std::is_function<remove_reference_t<Callee>>::value &&
 		!std::is_same<Ret, void>::value,
 	Ret>
-await(suspender_i spdr, Callee &&callee, Args &&...args) {
+await(
+	thread_pool &pool, suspender_i spdr, Callee &&callee, Args &&...args) {
 	assert(spdr);
 
 	if (spdr.type_is<thread_suspender>()) {
 		return std::forward<Callee>(callee)(std::forward<Args>(args)...);
 	}
-	auto ch_ptr = new chan<Ret>;
-	std::unique_ptr<chan<Ret>> ch_uptr(ch_ptr);
-	async([=]() mutable { *ch_ptr << callee(args...); });
-	return ch_ptr->pop(std::move(spdr));
+	return _await_on_pool(
+		pool, std::move(spdr), [callee, args...]() mutable -> Ret {
+			return callee(args...);
+		});
+}
+
+template <typename Ret, typename... Args>
+inline Ret await(
+	thread_pool &pool,
+	suspender_i spdr,
+	Ret (&callee)(Args...),
+	Args... args) {
+	return await(pool, std::move(spdr), &callee, std::move(args)...);
+}
+
+template <
+	typename Callee,
+	typename... Args,
+	typename Ret =
+		decltype(std::declval<Callee &&>()(std::declval<Args &&>()...))>
+inline enable_if_t<!std::is_function<remove_reference_t<Callee>>::value, Ret>
+await(suspender_i spdr, Callee &&callee, Args &&...args) {
+	return await(
+		blocking_pool(),
+		std::move(spdr),
+		std::forward<Callee>(callee),
+		std::forward<Args>(args)...);
 }
 
 template <typename Ret, typename... Args>
@@ -62,6 +139,25 @@ inline Ret await(suspender_i spdr, Ret (&callee)(Args...), Args... args) {
 	return await(std::move(spdr), &callee, std::move(args)...);
 }
 
+template <
+	typename Callee,
+	typename... Args,
+	typename Ret =
+		decltype(std::declval<Callee &&>()(std::declval<Args &&>()...))>
+inline enable_if_t<!std::is_function<remove_reference_t<Callee>>::value, Ret>
+await(thread_pool &pool, Callee &&callee, Args &&...args) {
+	return await(
+		pool,
+		this_suspender(),
+		std::forward<Callee>(callee),
+		std::forward<Args>(args)...);
+}
+
+template <typename Ret, typename... Args>
+inline Ret await(thread_pool &pool, Ret (&callee)(Args...), Args... args) {
+	return await(pool, &callee, std::move(args)...);
+}
+
 template <
 	typename Callee,
 	typename... Args,
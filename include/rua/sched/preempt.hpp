@@ -0,0 +1,50 @@
+#ifndef _RUA_SCHED_PREEMPT_HPP
+#define _RUA_SCHED_PREEMPT_HPP
+
+#include "suspender/this.hpp"
+
+#include "../macros.hpp"
+
+#ifdef __linux__
+
+#include "preempt/posix.hpp"
+
+namespace rua {
+
+using preempt_timer = posix::preempt_timer;
+
+} // namespace rua
+
+#else
+
+#include "preempt/uni.hpp"
+
+namespace rua {
+
+using preempt_timer = uni::preempt_timer;
+
+} // namespace rua
+
+#endif
+
+namespace rua {
+
+inline preempt_timer *&_this_preempt_timer() {
+	static thread_local preempt_timer *inst = nullptr;
+	return inst;
+}
+
+// A safe point for long-running tasks, yields only when the time slice of
+// the current preempt_timer has expired.
+inline void preempt_point() {
+	auto pt = _this_preempt_timer();
+	if (!pt || !pt->is_expired()) {
+		return;
+	}
+	pt->reset();
+	yield();
+}
+
+} // namespace rua
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef _RUA_SCHED_PREEMPT_POSIX_HPP
+#define _RUA_SCHED_PREEMPT_POSIX_HPP
+
+// Linux only, the timer signal is bound to a thread by SIGEV_THREAD_ID.
+
+#include "../../chrono/duration.hpp"
+#include "../../macros.hpp"
+
+#ifndef __linux__
+#error rua::posix::preempt_timer: SIGEV_THREAD_ID is only supported on Linux!
+#endif
+
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace rua { namespace posix {
+
+// Sets a flag from SIGURG sent by a timer bound to the creating thread, the
+// flag is polled at safe points so no code is interrupted mid-flight. The
+// timer is one-shot and only rearmed when the flag is consumed, so a busy
+// fiber gets one signal per slice at most.
+//
+// The flag belongs to the creating thread rather than to the timer, because a
+// queued signal may still be delivered after timer_delete(). Timers created by
+// the same thread share it.
+class preempt_timer {
+public:
+	explicit preempt_timer(duration time_slice) :
+		_slice(time_slice),
+		_expired(&_this_thread_expired()),
+		_valid(false),
+		_is_started(false) {
+		_init_sig();
+
+		sigevent sev;
+		std::memset(&sev, 0, sizeof(sev));
+		sev.sigev_notify = SIGEV_THREAD_ID;
+		sev.sigev_signo = SIGURG;
+		sev.sigev_value.sival_ptr = _expired;
+#ifdef sigev_notify_thread_id
+		sev.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+#else
+		sev._sigev_un._tid = static_cast<pid_t>(syscall(SYS_gettid));
+#endif
+		_valid = !timer_create(CLOCK_MONOTONIC, &sev, &_tmr);
+	}
+
+	~preempt_timer() {
+		if (!_valid) {
+			return;
+		}
+		timer_delete(_tmr);
+		_valid = false;
+	}
+
+	preempt_timer(const preempt_timer &) = delete;
+
+	preempt_timer &operator=(const preempt_timer &) = delete;
+
+	duration time_slice() const {
+		return _slice;
+	}
+
+	void start() {
+		_is_started = true;
+		_expired->store(false, std::memory_order_relaxed);
+		_arm();
+	}
+
+	void stop() {
+		_is_started = false;
+		if (!_valid) {
+			return;
+		}
+		itimerspec its;
+		std::memset(&its, 0, sizeof(its));
+		timer_settime(_tmr, 0, &its, nullptr);
+	}
+
+	void reset() {
+		if (_expired->exchange(false, std::memory_order_relaxed) &&
+			_is_started) {
+			_arm();
+		}
+	}
+
+	bool is_expired() const {
+		return _expired->load(std::memory_order_relaxed);
+	}
+
+private:
+	duration _slice;
+	std::atomic<bool> *_expired;
+	timer_t _tmr;
+	bool _valid, _is_started;
+
+	void _arm() {
+		if (!_valid) {
+			return;
+		}
+		itimerspec its;
+		std::memset(&its, 0, sizeof(its));
+		its.it_value = _slice.c_timespec();
+		timer_settime(_tmr, 0, &its, nullptr);
+	}
+
+	// Constant initialized without a destructor, so it stays valid until the
+	// thread exits, and signals sent to the thread end with it.
+	static std::atomic<bool> &_this_thread_expired() {
+		static thread_local std::atomic<bool> expired(false);
+		return expired;
+	}
+
+	static struct sigaction &_prev_sa() {
+		static struct sigaction inst;
+		return inst;
+	}
+
+	// Signals of other timers and senders go to the previous handler.
+	static void _on_sig(int sig, siginfo_t *si, void *uc) {
+		auto &expired = _this_thread_expired();
+		if (si->si_code == SI_TIMER && si->si_value.sival_ptr == &expired) {
+			expired.store(true, std::memory_order_relaxed);
+			return;
+		}
+		auto &prev = _prev_sa();
+		if (prev.sa_flags & SA_SIGINFO) {
+			prev.sa_sigaction(sig, si, uc);
+			return;
+		}
+		if (prev.sa_handler != SIG_DFL && prev.sa_handler != SIG_IGN) {
+			prev.sa_handler(sig);
+		}
+	}
+
+	static void _init_sig() {
+		RUA_ONCE_CODE({
+			struct sigaction sa;
+			std::memset(&sa, 0, sizeof(sa));
+			sa.sa_sigaction = &_on_sig;
+			sa.sa_flags = SA_SIGINFO | SA_RESTART;
+			sigemptyset(&sa.sa_mask);
+			sigaction(SIGURG, &sa, &_prev_sa());
+		});
+	}
+};
+
+}} // namespace rua::posix
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _RUA_SCHED_PREEMPT_UNI_HPP
+#define _RUA_SCHED_PREEMPT_UNI_HPP
+
+#include "../../chrono/tick.hpp"
+
+namespace rua { namespace uni {
+
+class preempt_timer {
+public:
+	explicit preempt_timer(duration time_slice) :
+		_slice(time_slice), _end_ti(time_max()) {}
+
+	preempt_timer(const preempt_timer &) = delete;
+
+	preempt_timer &operator=(const preempt_timer &) = delete;
+
+	duration time_slice() const {
+		return _slice;
+	}
+
+	void start() {
+		reset();
+	}
+
+	void stop() {
+		_end_ti = time_max();
+	}
+
+	void reset() {
+		_end_ti = tick() + _slice;
+	}
+
+	bool is_expired() const {
+		return tick() >= _end_ti;
+	}
+
+private:
+	duration _slice;
+	time _end_ti;
+};
+
+}} // namespace rua::uni
+
+#endif
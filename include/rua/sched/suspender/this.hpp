@@ -11,13 +11,42 @@
 
 namespace rua {
 
+// Points to the suspender slot of the current thread, which lives in thread
+// storage rather than on any stack. Constant initialized, so reading it is a
+// plain TLS load.
+inline suspender_i *&_this_suspender_cache() {
+	static thread_local suspender_i *cache = nullptr;
+	return cache;
+}
+
+struct _suspender_slot {
+	suspender_i spdr;
+
+	explicit _suspender_slot(suspender_i s) : spdr(std::move(s)) {}
+
+	// Thread vars may still call this_suspender() while the thread exits, a
+	// new slot with a default suspender is made then.
+	~_suspender_slot() {
+		auto &cache = _this_suspender_cache();
+		if (cache == &spdr) {
+			cache = nullptr;
+		}
+	}
+};
+
 inline suspender_i &_this_suspender_ref() {
-	static thread_var<suspender_i> sto;
+	auto cur = _this_suspender_cache();
+	if (cur) {
+		return *cur;
+	}
+	static thread_var<_suspender_slot> sto;
 	if (!sto.has_value()) {
-		return sto.emplace(make_default_suspender());
+		sto.emplace(make_default_suspender());
 	}
-	assert(sto.value().get());
-	return sto.value();
+	cur = &sto.value().spdr;
+	assert(cur->get());
+	_this_suspender_cache() = cur;
+	return *cur;
 }
 
 inline suspender_i this_suspender() {
@@ -0,0 +1,298 @@
+#ifndef _RUA_SCHED_THREAD_POOL_HPP
+#define _RUA_SCHED_THREAD_POOL_HPP
+
+#include "suspender.hpp"
+
+#include "../chrono/duration.hpp"
+#include "../move_only.hpp"
+#include "../optional.hpp"
+#include "../sync/future.hpp"
+#include "../sync/lockfree_list.hpp"
+#include "../sync/lockfree_queue.hpp"
+#include "../sync/waiters.hpp"
+#include "../thread/basic.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace rua {
+
+struct thread_pool_options {
+	size_t min_worker_count;
+	size_t max_worker_count;
+	duration idle_timeout;
+};
+
+// Workers are spawned on demand up to max_worker_c, and workers beyond
+// min_worker_c exit after idling for idle_timeout.
+//
+// Tasks posted from a worker go to its own queue, other tasks go to a shared
+// queue. An idle worker takes tasks from its own queue, then the shared queue,
+// then steals from the other workers.
+//
+// Workers finish the queued tasks even if the pool has been destroyed.
+class thread_pool {
+public:
+	explicit thread_pool(
+		size_t min_worker_c = 0,
+		size_t max_worker_c = default_max_worker_count(),
+		duration idle_timeout = seconds(60)) :
+		_st(std::make_shared<_state_t>(
+			min_worker_c,
+			max_worker_c < 1 ? 1 : max_worker_c,
+			idle_timeout)) {
+		for (size_t i = 0; i < _st->min_c && _st->spawn(_st); ++i)
+			;
+	}
+
+	explicit thread_pool(const thread_pool_options &opts) :
+		thread_pool(
+			opts.min_worker_count, opts.max_worker_count, opts.idle_timeout) {}
+
+	~thread_pool() {
+		_st->is_stopping.store(true);
+		_resume_all(_st->idlers);
+	}
+
+	thread_pool(const thread_pool &) = delete;
+
+	thread_pool &operator=(const thread_pool &) = delete;
+
+	static size_t default_max_worker_count() {
+		auto c = cpu_count() * 4;
+		return c < 16 ? 16 : c;
+	}
+
+	static size_t cpu_count() {
+		auto c = static_cast<size_t>(std::thread::hardware_concurrency());
+		return c ? c : 1;
+	}
+
+	size_t worker_count() const {
+		return _st->live_c.load();
+	}
+
+	size_t max_worker_count() const {
+		return _st->max_c;
+	}
+
+	void post(std::function<void()> task) {
+		assert(task);
+
+		_post(_task_t(std::move(task)));
+	}
+
+	// Runs fn(ctx) without allocating, the caller keeps ctx alive until then.
+	void post(void (*fn)(void *), void *ctx) {
+		assert(fn);
+
+		_post(_task_t(fn, ctx));
+	}
+
+	// Waiting on the future from a worker of the same pool blocks that worker,
+	// so it deadlocks when every worker waits, such as with one worker.
+	template <
+		typename Callee,
+		typename Ret = decltype(std::declval<decay_t<Callee> &>()())>
+	future<Ret> submit(Callee &&callee) {
+		promise<Ret> prm;
+		auto fut = prm.get_future();
+		move_only<promise<Ret>> prm_mo(std::move(prm));
+		decay_t<Callee> fn(std::forward<Callee>(callee));
+		post([prm_mo, fn]() mutable { _fulfill(prm_mo.value(), fn); });
+		return fut;
+	}
+
+private:
+	struct _task_t {
+		void (*fn)(void *);
+		void *ctx;
+		std::function<void()> obj;
+
+		explicit _task_t(std::function<void()> obj) :
+			fn(nullptr), ctx(nullptr), obj(std::move(obj)) {}
+
+		_task_t(void (*fn)(void *), void *ctx) : fn(fn), ctx(ctx), obj() {}
+
+		void operator()() {
+			if (fn) {
+				fn(ctx);
+				return;
+			}
+			obj();
+		}
+	};
+
+	struct _worker_t {
+		lockfree_queue<_task_t> que;
+		std::atomic<bool> is_used;
+
+		_worker_t() : que(), is_used(false) {}
+	};
+
+	struct _state_t {
+		const size_t min_c, max_c;
+		const duration idle_timeout;
+		std::unique_ptr<_worker_t[]> wkrs;
+		lockfree_queue<_task_t> que;
+		lockfree_list<resumer_i> idlers;
+		std::atomic<size_t> live_c;
+		std::atomic<bool> is_stopping;
+
+		_state_t(size_t min_c, size_t max_c, duration idle_timeout) :
+			min_c(min_c),
+			max_c(max_c),
+			idle_timeout(idle_timeout),
+			wkrs(new _worker_t[max_c]),
+			que(),
+			idlers(),
+			live_c(0),
+			is_stopping(false) {}
+
+		optional<_task_t> pop(size_t ix) {
+			auto task_opt = wkrs[ix].que.pop();
+			if (task_opt) {
+				return task_opt;
+			}
+			task_opt = que.pop();
+			if (task_opt) {
+				return task_opt;
+			}
+			for (size_t i = 1; i < max_c; ++i) {
+				auto &vic = wkrs[(ix + i) % max_c].que;
+				if (vic.empty()) {
+					continue;
+				}
+				task_opt = vic.pop();
+				if (task_opt) {
+					return task_opt;
+				}
+			}
+			return task_opt;
+		}
+
+		bool has_task() const {
+			if (!que.empty()) {
+				return true;
+			}
+			for (size_t i = 0; i < max_c; ++i) {
+				if (!wkrs[i].que.empty()) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Idle workers check the queues under the idler list lock, so an empty
+		// list means no worker has missed the task.
+		void notify(const std::shared_ptr<_state_t> &self) {
+			if (!idlers.empty() && _resume_one(idlers)) {
+				return;
+			}
+			spawn(self);
+		}
+
+		bool spawn(const std::shared_ptr<_state_t> &self) {
+			auto c = live_c.load();
+			do {
+				if (c >= max_c) {
+					return false;
+				}
+			} while (!live_c.compare_exchange_weak(c, c + 1));
+
+			// A reaped worker may not have released its slot yet.
+			for (size_t i = 0;; i = (i + 1) % max_c) {
+				auto is_used = false;
+				if (wkrs[i].is_used.compare_exchange_strong(is_used, true)) {
+					thread([self, i]() { _work(self, i); });
+					return true;
+				}
+			}
+		}
+	};
+
+	struct _this_worker_t {
+		_state_t *st;
+		size_t ix;
+	};
+
+	std::shared_ptr<_state_t> _st;
+
+	void _post(_task_t task) {
+		auto &wkr = _this_worker();
+		if (wkr.st == _st.get()) {
+			_st->wkrs[wkr.ix].que.emplace(std::move(task));
+		} else {
+			_st->que.emplace(std::move(task));
+		}
+		_st->notify(_st);
+	}
+
+	static _this_worker_t &_this_worker() {
+		static thread_local _this_worker_t wkr{nullptr, 0};
+		return wkr;
+	}
+
+	template <typename Callee>
+	static void _fulfill(promise<void> &prm, Callee &callee) {
+		callee();
+		prm.set_value(true);
+	}
+
+	template <typename Ret, typename Callee>
+	static enable_if_t<!std::is_void<Ret>::value>
+	_fulfill(promise<Ret> &prm, Callee &callee) {
+		prm.set_value(callee());
+	}
+
+	static void _work(std::shared_ptr<_state_t> st, size_t ix) {
+		_this_worker() = {st.get(), ix};
+
+		optional<_task_t> task_opt;
+		for (;;) {
+			if (_wait_until(
+					st->idlers,
+					[&]() -> bool {
+						task_opt = st->pop(ix);
+						return task_opt || st->is_stopping.load();
+					},
+					this_suspender(),
+					st->idle_timeout)) {
+				if (!task_opt) {
+					break;
+				}
+				task_opt.value()();
+				task_opt.reset();
+				continue;
+			}
+
+			auto c = st->live_c.load();
+			if (c <= st->min_c) {
+				continue;
+			}
+			if (st->live_c.compare_exchange_strong(c, c - 1)) {
+				st->wkrs[ix].is_used.store(false);
+				_this_worker() = {nullptr, 0};
+
+				// A task posted after the last check may have seen a full
+				// pool with no idle workers.
+				if (st->has_task()) {
+					st->notify(st);
+				}
+				return;
+			}
+		}
+
+		_this_worker() = {nullptr, 0};
+		st->wkrs[ix].is_used.store(false);
+		--st->live_c;
+	}
+};
+
+} // namespace rua
+
+#endif
@@ -1,9 +1,25 @@
 #ifndef _RUA_SYNC_HPP
 #define _RUA_SYNC_HPP
 
+#include "sync/backoff.hpp"
+#include "sync/barrier.hpp"
+#include "sync/bounded_chan.hpp"
 #include "sync/chan.hpp"
+#include "sync/concurrent_hash_map.hpp"
+#include "sync/condition_variable.hpp"
+#include "sync/future.hpp"
+#include "sync/hazard_ptr.hpp"
+#include "sync/latch.hpp"
 #include "sync/lock_guard.hpp"
+#include "sync/lock_prof.hpp"
 #include "sync/lockfree_list.hpp"
+#include "sync/lockfree_queue.hpp"
+#include "sync/lockfree_stack.hpp"
 #include "sync/mutex.hpp"
+#include "sync/select.hpp"
+#include "sync/semaphore.hpp"
+#include "sync/shared_mutex.hpp"
+#include "sync/spsc_chan.hpp"
+#include "sync/waiters.hpp"
 
 #endif
@@ -0,0 +1,50 @@
+#ifndef _RUA_SYNC_BACKOFF_HPP
+#define _RUA_SYNC_BACKOFF_HPP
+
+#include "../macros.hpp"
+
+#include <cstddef>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
+namespace rua {
+
+inline void cpu_pause() {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	_mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+// Exponential backoff for spin loops, the pause count doubles on each call up
+// to max_pause_count.
+class backoff {
+public:
+	constexpr explicit backoff(size_t max_pause_count = 64) :
+		_c(1), _max_c(max_pause_count) {}
+
+	void pause() {
+		for (size_t i = 0; i < _c; ++i) {
+			cpu_pause();
+		}
+		if (_c < _max_c) {
+			_c <<= 1;
+		}
+	}
+
+	void reset() {
+		_c = 1;
+	}
+
+private:
+	size_t _c, _max_c;
+};
+
+} // namespace rua
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef _RUA_SYNC_BARRIER_HPP
+#define _RUA_SYNC_BARRIER_HPP
+
+#include "lockfree_list.hpp"
+#include "waiters.hpp"
+
+#include "../sched/suspender.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+
+namespace rua {
+
+// Reusable, on_completion is called by the last arriving party of each phase
+// before the others are released.
+class barrier {
+public:
+	explicit barrier(
+		ptrdiff_t expected, std::function<void()> on_completion = nullptr) :
+		_expected(expected),
+		_remaining(expected),
+		_phase(0),
+		_on_cpl(std::move(on_completion)),
+		_waiters() {}
+
+	barrier(const barrier &) = delete;
+
+	barrier &operator=(const barrier &) = delete;
+
+	// Returns the phase to pass to wait().
+	size_t arrive(ptrdiff_t update = 1) {
+		auto phase = _phase.load();
+		auto remaining = _remaining -= update;
+		assert(remaining >= 0);
+		if (!remaining) {
+			_complete();
+		}
+		return phase;
+	}
+
+	bool wait(size_t phase, duration timeout = duration_max()) {
+		return wait(this_suspender(), phase, timeout);
+	}
+
+	bool
+	wait(suspender_i spdr, size_t phase, duration timeout = duration_max()) {
+		return _wait_until(
+			_waiters,
+			[this, phase]() -> bool { return _phase.load() != phase; },
+			std::move(spdr),
+			timeout);
+	}
+
+	void arrive_and_wait() {
+		wait(arrive());
+	}
+
+	void arrive_and_wait(suspender_i spdr) {
+		auto phase = arrive();
+		wait(std::move(spdr), phase);
+	}
+
+	// Leaves the barrier, the following phases expect one party less.
+	void arrive_and_drop() {
+		--_expected;
+		arrive();
+	}
+
+private:
+	std::atomic<ptrdiff_t> _expected, _remaining;
+	std::atomic<size_t> _phase;
+	std::function<void()> _on_cpl;
+	lockfree_list<resumer_i> _waiters;
+
+	void _complete() {
+		if (_on_cpl) {
+			_on_cpl();
+		}
+		_remaining.store(_expected.load());
+		++_phase;
+		_resume_all(_waiters);
+	}
+};
+
+} // namespace rua
+
+#endif
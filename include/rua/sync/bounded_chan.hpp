@@ -0,0 +1,223 @@
+#ifndef _RUA_SYNC_BOUNDED_CHAN_HPP
+#define _RUA_SYNC_BOUNDED_CHAN_HPP
+
+#include "lockfree_list.hpp"
+#include "waiters.hpp"
+
+#include "../macros.hpp"
+#include "../optional.hpp"
+#include "../sched/suspender.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+namespace rua {
+
+struct _select_access;
+
+// Vyukov's bounded MPMC queue, senders are suspended while it is full.
+template <typename T>
+class bounded_chan {
+public:
+	explicit bounded_chan(size_t capacity) :
+		_mask(_round_up(capacity) - 1),
+		_cels(new _cell_t[_mask + 1]),
+		_head(0),
+		_tail(0) {
+		for (size_t i = 0; i <= _mask; ++i) {
+			_cels[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~bounded_chan() {
+		optional<T> val_opt;
+		while (_pop_raw(val_opt)) {
+			val_opt.reset();
+		}
+	}
+
+	bounded_chan(const bounded_chan &) = delete;
+
+	bounded_chan &operator=(const bounded_chan &) = delete;
+
+	size_t capacity() const {
+		return _mask + 1;
+	}
+
+	bool empty() const {
+		auto pos = _head.load(std::memory_order_relaxed);
+		return _cels[pos & _mask].seq.load(std::memory_order_acquire) !=
+			   pos + 1;
+	}
+
+	template <typename... Args>
+	bool try_emplace(Args &&...args) {
+		if (!_emplace_raw(std::forward<Args>(args)...)) {
+			return false;
+		}
+		_resume_one(_recv_waiters);
+		return true;
+	}
+
+	template <typename... Args>
+	void emplace(Args &&...args) {
+		_wait_and_emplace(
+			this_suspender(), duration_max(), std::forward<Args>(args)...);
+	}
+
+	bool try_push(T val, duration timeout) {
+		return _wait_and_emplace(this_suspender(), timeout, std::move(val));
+	}
+
+	bool try_push(suspender_i spdr, T val, duration timeout) {
+		return _wait_and_emplace(std::move(spdr), timeout, std::move(val));
+	}
+
+	void push(T val) {
+		_wait_and_emplace(this_suspender(), duration_max(), std::move(val));
+	}
+
+	void push(suspender_i spdr, T val) {
+		_wait_and_emplace(std::move(spdr), duration_max(), std::move(val));
+	}
+
+	optional<T> try_pop() {
+		optional<T> val_opt;
+		if (_pop_raw(val_opt)) {
+			_resume_one(_send_waiters);
+		}
+		return val_opt;
+	}
+
+	optional<T> try_pop(duration timeout) {
+		return try_pop(this_suspender(), timeout);
+	}
+
+	optional<T> try_pop(suspender_i spdr, duration timeout) {
+		optional<T> val_opt;
+		if (_wait_until(
+				_recv_waiters,
+				[&]() -> bool { return _pop_raw(val_opt); },
+				std::move(spdr),
+				timeout)) {
+			_resume_one(_send_waiters);
+		}
+		return val_opt;
+	}
+
+	T pop() {
+		return try_pop(duration_max()).value();
+	}
+
+	T pop(suspender_i spdr) {
+		return try_pop(std::move(spdr), duration_max()).value();
+	}
+
+private:
+	struct _cell_t {
+		std::atomic<size_t> seq;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type sto;
+	};
+
+	const size_t _mask;
+	std::unique_ptr<_cell_t[]> _cels;
+
+	char _pad0[RUA_CACHE_LINE_SIZE];
+	std::atomic<size_t> _head;
+	char _pad1[RUA_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> _tail;
+	char _pad2[RUA_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+	lockfree_list<resumer_i> _recv_waiters;
+	lockfree_list<resumer_i> _send_waiters;
+
+	static size_t _round_up(size_t n) {
+		size_t r = 2;
+		while (r < n) {
+			r <<= 1;
+		}
+		return r;
+	}
+
+	template <typename... Args>
+	bool _emplace_raw(Args &&...args) {
+		auto pos = _tail.load(std::memory_order_relaxed);
+		for (;;) {
+			auto &cel = _cels[pos & _mask];
+			auto seq = cel.seq.load(std::memory_order_acquire);
+			auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (!dif) {
+				if (_tail.compare_exchange_weak(
+						pos, pos + 1, std::memory_order_relaxed)) {
+					new (&cel.sto) T(std::forward<Args>(args)...);
+					cel.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = _tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool _pop_raw(optional<T> &val_opt) {
+		auto pos = _head.load(std::memory_order_relaxed);
+		for (;;) {
+			auto &cel = _cels[pos & _mask];
+			auto seq = cel.seq.load(std::memory_order_acquire);
+			auto dif =
+				static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+			if (!dif) {
+				if (_head.compare_exchange_weak(
+						pos, pos + 1, std::memory_order_relaxed)) {
+					auto val_ptr = reinterpret_cast<T *>(&cel.sto);
+					val_opt.emplace(std::move(*val_ptr));
+					val_ptr->~T();
+					cel.seq.store(pos + _mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = _head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	template <typename... Args>
+	bool
+	_wait_and_emplace(suspender_i spdr, duration timeout, Args &&...args) {
+		if (!_wait_until(
+				_send_waiters,
+				[&]() -> bool {
+					return _emplace_raw(std::forward<Args>(args)...);
+				},
+				std::move(spdr),
+				timeout)) {
+			return false;
+		}
+		_resume_one(_recv_waiters);
+		return true;
+	}
+
+	friend _select_access;
+};
+
+template <typename T, typename V>
+inline bounded_chan<T> &operator<<(bounded_chan<T> &ch, V &&val) {
+	ch.emplace(std::forward<V>(val));
+	return ch;
+}
+
+template <typename T, typename R>
+inline bounded_chan<T> &operator<<(R &receiver, bounded_chan<T> &ch) {
+	receiver = ch.pop();
+	return ch;
+}
+
+} // namespace rua
+
+#endif
@@ -1,21 +1,39 @@
 #ifndef _RUA_SYNC_CHAN_HPP
 #define _RUA_SYNC_CHAN_HPP
 
+#include "lock_prof.hpp"
 #include "lockfree_list.hpp"
+#include "lockfree_queue.hpp"
+#include "waiters.hpp"
 
-#include "../chrono/tick.hpp"
+#include "../macros.hpp"
 #include "../optional.hpp"
 #include "../sched/suspender.hpp"
 #include "../types/util.hpp"
 
 #include <atomic>
+#include <vector>
 
 namespace rua {
 
+struct _select_access;
+struct _coro_access;
+
 template <typename T>
 class chan {
 public:
-	constexpr chan() : _buf(), _waiters() {}
+	constexpr chan() : chan("rua::chan") {}
+
+	// The name identifies the channel in lock_prof_report().
+	constexpr explicit chan(RUA_MAYBE_UNUSED const char *name) :
+		_buf(),
+		_waiters()
+#ifdef RUA_LOCK_PROF
+		,
+		_prof(name)
+#endif
+	{
+	}
 
 	chan(const chan &) = delete;
 
@@ -23,34 +41,51 @@ public:
 
 	template <typename... Args>
 	bool emplace(Args &&...args) {
-		_buf.emplace_front(std::forward<Args>(args)...);
-		auto waiter_opt = _waiters.pop_back_if([&]() -> bool { return _buf; });
-		if (!waiter_opt) {
-			return false;
-		}
-		waiter_opt.value()->resume();
-		return true;
+		_buf.emplace(std::forward<Args>(args)...);
+		return _resume_waiters(1);
+	}
+
+	// Returns the number of resumed waiters.
+	template <typename InputIt>
+	size_t emplace_many(InputIt first, InputIt last) {
+		return _resume_waiters(_buf.emplace_many(first, last));
+	}
+
+	bool empty() const {
+		return _buf.empty();
 	}
 
 	optional<T> try_pop() {
-		return _buf.pop_back();
+#ifdef RUA_LOCK_PROF
+		auto val_opt = _buf.pop();
+		if (val_opt) {
+			_prof.record();
+		}
+		return val_opt;
+#else
+		return _buf.pop();
+#endif
 	}
 
 	optional<T> try_pop(duration timeout) {
-		auto val_opt = _buf.pop_back();
-		if (val_opt || !timeout) {
-			return val_opt;
-		}
-		return _wait_and_pop(this_suspender(), timeout);
+		return try_pop(this_suspender(), timeout);
 	}
 
 	optional<T> try_pop(suspender_i spdr, duration timeout) {
-		auto val_opt = _buf.pop_back();
-		if (val_opt || !timeout || !spdr) {
+#ifdef RUA_LOCK_PROF
+		auto val_opt = try_pop();
+		if (val_opt) {
 			return val_opt;
 		}
+		auto t = tick();
 		val_opt = _wait_and_pop(std::move(spdr), timeout);
+		if (val_opt) {
+			_prof.record(tick() - t);
+		}
 		return val_opt;
+#else
+		return _wait_and_pop(std::move(spdr), timeout);
+#endif
 	}
 
 	T pop() {
@@ -61,58 +96,70 @@ public:
 		return try_pop(std::move(spdr), duration_max()).value();
 	}
 
+	// Waits for at least one value, then takes up to max_n without waiting.
+	std::vector<T> pop_many(size_t max_n, duration timeout = duration_max()) {
+		return pop_many(this_suspender(), max_n, timeout);
+	}
+
+	std::vector<T> pop_many(
+		suspender_i spdr, size_t max_n, duration timeout = duration_max()) {
+		std::vector<T> vals;
+		if (!max_n) {
+			return vals;
+		}
+		auto val_opt = try_pop(std::move(spdr), timeout);
+		if (!val_opt) {
+			return vals;
+		}
+		vals.emplace_back(std::move(val_opt.value()));
+		while (vals.size() < max_n) {
+			val_opt = _buf.pop();
+			if (!val_opt) {
+				break;
+			}
+			vals.emplace_back(std::move(val_opt.value()));
+		}
+		return vals;
+	}
+
 protected:
-	lockfree_list<T> _buf;
+	lockfree_queue<T> _buf;
 	lockfree_list<resumer_i> _waiters;
+#ifdef RUA_LOCK_PROF
+	lock_prof _prof;
+#endif
 
 	optional<T> _wait_and_pop(suspender_i spdr, duration timeout) {
-		assert(spdr);
-		assert(timeout);
-
 		optional<T> val_opt;
+		_wait_until(
+			_waiters,
+			[&]() -> bool {
+				val_opt = _buf.pop();
+				return val_opt.has_value();
+			},
+			std::move(spdr),
+			timeout);
+		return val_opt;
+	}
 
-		auto rsmr = spdr->get_resumer();
-
-		if (!_waiters.emplace_front_if(
-				[&]() -> bool {
-					val_opt = _buf.pop_back();
-					return !val_opt;
-				},
-				rsmr)) {
-			return val_opt;
-		}
-
-		if (timeout == duration_max()) {
-			for (;;) {
-				if (spdr->suspend(timeout) && !_waiters.emplace_front_if(
-												  [&]() -> bool {
-													  val_opt = _buf.pop_back();
-													  return !val_opt;
-												  },
-												  rsmr)) {
-					return val_opt;
-				}
-			}
-		}
-
-		for (;;) {
-			auto t = tick();
-			auto r = spdr->suspend(timeout);
-			timeout -= tick() - t;
-			if (timeout <= 0) {
-				return _buf.pop_back();
-			}
-			if (r && !_waiters.emplace_front_if(
-						 [&]() -> bool {
-							 val_opt = _buf.pop_back();
-							 return !val_opt;
-						 },
-						 rsmr)) {
-				return val_opt;
+	// Pushers see either the registered waiter or a receiver that checks the
+	// buffer under the waiter list lock, so an empty list can be skipped.
+	size_t _resume_waiters(size_t n) {
+		size_t c = 0;
+		while (c < n && !_waiters.empty()) {
+			auto waiter_opt =
+				_waiters.pop_back_if([&]() -> bool { return _buf; });
+			if (!waiter_opt) {
+				break;
 			}
+			waiter_opt.value()->resume();
+			++c;
 		}
-		return val_opt;
+		return c;
 	}
+
+	friend _select_access;
+	friend _coro_access;
 };
 
 template <typename T, typename V>
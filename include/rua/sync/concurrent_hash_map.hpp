@@ -0,0 +1,299 @@
+#ifndef _RUA_SYNC_CONCURRENT_HASH_MAP_HPP
+#define _RUA_SYNC_CONCURRENT_HASH_MAP_HPP
+
+#include "backoff.hpp"
+#include "hazard_ptr.hpp"
+
+#include "../macros.hpp"
+#include "../optional.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace rua {
+
+// Keys are spread over shards, each shard is a table of buckets, and each
+// bucket is an immutable array of entries. Readers only publish hazard
+// pointers, so they never block and do not write shared cache lines.
+//
+// Writers lock the shard with a spin lock and replace only the bucket of the
+// key. A write copies the entries of that bucket, one or two on average, and
+// allocates the new bucket. Growing the table rebuilds the buckets of the
+// shard, amortized over the inserts.
+//
+// Writers never suspend, the map is safe to use below the suspender layer.
+template <
+	typename K,
+	typename V,
+	typename Hash = std::hash<K>,
+	typename KeyEq = std::equal_to<K>>
+class concurrent_hash_map {
+public:
+	explicit concurrent_hash_map(size_t shard_count = 16) :
+		_mask(_round_up(shard_count) - 1),
+		_shard_bit_c(_bit_count(_mask)),
+		_shards(new _shard_t[_mask + 1]) {}
+
+	~concurrent_hash_map() {
+		for (size_t i = 0; i <= _mask; ++i) {
+			delete _shards[i].tab.load();
+		}
+	}
+
+	concurrent_hash_map(const concurrent_hash_map &) = delete;
+
+	concurrent_hash_map &operator=(const concurrent_hash_map &) = delete;
+
+	size_t size() const {
+		size_t c = 0;
+		for (size_t i = 0; i <= _mask; ++i) {
+			c += _shards[i].size.load(std::memory_order_relaxed);
+		}
+		return c;
+	}
+
+	bool empty() const {
+		return !size();
+	}
+
+	// Calls f(const V &) while the value is protected, returns false if the
+	// key is absent.
+	template <typename F>
+	bool visit(const K &key, F &&f) const {
+		auto h = _hash(key);
+		hazard_ptr tab_hp;
+		auto tab = tab_hp.protect(_shards[h & _mask].tab);
+		if (!tab) {
+			return false;
+		}
+		hazard_ptr bkt_hp;
+		auto bkt = bkt_hp.protect(tab->bkts[_bucket_ix(*tab, h)]);
+		if (!bkt) {
+			return false;
+		}
+		for (auto &ent : *bkt) {
+			if (KeyEq()(ent.first, key)) {
+				f(static_cast<const V &>(ent.second));
+				return true;
+			}
+		}
+		return false;
+	}
+
+	optional<V> find(const K &key) const {
+		optional<V> r;
+		visit(key, [&r](const V &val) { r.emplace(val); });
+		return r;
+	}
+
+	bool contains(const K &key) const {
+		return visit(key, [](const V &) {});
+	}
+
+	// Calls f(optional<V> &) with the current value under the shard write
+	// lock, f may emplace, modify or reset it.
+	template <typename F>
+	void compute(const K &key, F &&f) {
+		auto h = _hash(key);
+		auto &shd = _shards[h & _mask];
+		_shard_lock_guard lg(shd);
+
+		auto tab = shd.tab.load();
+		if (!tab) {
+			tab = new _table_t(8);
+			shd.tab.store(tab);
+		}
+		auto &bkt_ref = tab->bkts[_bucket_ix(*tab, h)];
+		auto old_bkt = bkt_ref.load();
+
+		optional<V> val_opt;
+		size_t pos = 0;
+		if (old_bkt) {
+			for (; pos < old_bkt->size(); ++pos) {
+				if (KeyEq()((*old_bkt)[pos].first, key)) {
+					val_opt.emplace((*old_bkt)[pos].second);
+					break;
+				}
+			}
+		}
+		auto is_found = val_opt.has_value();
+
+		f(val_opt);
+		if (!val_opt && !is_found) {
+			return;
+		}
+
+		std::unique_ptr<_bucket_t> new_bkt;
+		if (old_bkt && (val_opt || old_bkt->size() > 1)) {
+			new_bkt.reset(new _bucket_t());
+			new_bkt->reserve(old_bkt->size() + 1);
+			for (size_t i = 0; i < old_bkt->size(); ++i) {
+				if (i != pos) {
+					new_bkt->emplace_back((*old_bkt)[i]);
+				}
+			}
+		} else if (val_opt) {
+			new_bkt.reset(new _bucket_t());
+		}
+		if (val_opt) {
+			new_bkt->emplace_back(key, std::move(val_opt.value()));
+		}
+
+		bkt_ref.store(new_bkt.release());
+		if (old_bkt) {
+			hazard_retire(old_bkt);
+		}
+
+		if (is_found == val_opt.has_value()) {
+			return;
+		}
+		auto sz = shd.size.load(std::memory_order_relaxed);
+		sz = val_opt ? sz + 1 : sz - 1;
+		shd.size.store(sz, std::memory_order_relaxed);
+		if (sz > tab->bkt_c) {
+			_grow(shd, tab);
+		}
+	}
+
+	void insert_or_assign(const K &key, V val) {
+		compute(key, [&val](optional<V> &val_opt) {
+			val_opt.emplace(std::move(val));
+		});
+	}
+
+	// Returns false if the key already exists.
+	template <typename... Args>
+	bool emplace(const K &key, Args &&...args) {
+		auto is_emplaced = false;
+		compute(key, [&](optional<V> &val_opt) {
+			if (val_opt) {
+				return;
+			}
+			val_opt.emplace(std::forward<Args>(args)...);
+			is_emplaced = true;
+		});
+		return is_emplaced;
+	}
+
+	bool erase(const K &key) {
+		auto is_erased = false;
+		compute(key, [&is_erased](optional<V> &val_opt) {
+			is_erased = val_opt.has_value();
+			val_opt.reset();
+		});
+		return is_erased;
+	}
+
+private:
+	using _bucket_t = std::vector<std::pair<K, V>>;
+
+	// Owns the buckets it points to when it is destroyed, replaced buckets
+	// are retired on their own.
+	struct _table_t {
+		const size_t bkt_c;
+		std::unique_ptr<std::atomic<_bucket_t *>[]> bkts;
+
+		explicit _table_t(size_t bkt_c) :
+			bkt_c(bkt_c), bkts(new std::atomic<_bucket_t *>[bkt_c]) {
+			for (size_t i = 0; i < bkt_c; ++i) {
+				bkts[i].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		~_table_t() {
+			for (size_t i = 0; i < bkt_c; ++i) {
+				delete bkts[i].load();
+			}
+		}
+	};
+
+	struct _shard_t {
+		std::atomic<_table_t *> tab;
+		std::atomic<size_t> size;
+		std::atomic<bool> is_locked;
+		char pad
+			[RUA_CACHE_LINE_SIZE - sizeof(std::atomic<_table_t *>) -
+			 sizeof(std::atomic<size_t>) - sizeof(std::atomic<bool>)];
+
+		_shard_t() : tab(nullptr), size(0), is_locked(false) {}
+	};
+
+	class _shard_lock_guard {
+	public:
+		explicit _shard_lock_guard(_shard_t &shd) : _shd(shd) {
+			backoff bo;
+			while (_shd.is_locked.exchange(true, std::memory_order_acquire)) {
+				bo.pause();
+			}
+		}
+
+		~_shard_lock_guard() {
+			_shd.is_locked.store(false, std::memory_order_release);
+		}
+
+	private:
+		_shard_t &_shd;
+	};
+
+	const size_t _mask;
+	const size_t _shard_bit_c;
+	std::unique_ptr<_shard_t[]> _shards;
+
+	static size_t _round_up(size_t n) {
+		size_t r = 1;
+		while (r < n) {
+			r <<= 1;
+		}
+		return r;
+	}
+
+	static size_t _bit_count(size_t mask) {
+		size_t c = 0;
+		for (; mask; mask >>= 1) {
+			++c;
+		}
+		return c;
+	}
+
+	static size_t _hash(const K &key) {
+		auto h = Hash()(key);
+		// Mix the high bits in, std::hash is the identity for integers.
+		return h ^ (h >> 16);
+	}
+
+	// The low bits select the shard.
+	size_t _bucket_ix(const _table_t &tab, size_t h) const {
+		return (h >> _shard_bit_c) & (tab.bkt_c - 1);
+	}
+
+	// Called under the shard lock.
+	void _grow(_shard_t &shd, _table_t *old_tab) {
+		std::unique_ptr<_table_t> new_tab(new _table_t(old_tab->bkt_c * 2));
+		for (size_t i = 0; i < old_tab->bkt_c; ++i) {
+			auto old_bkt = old_tab->bkts[i].load();
+			if (!old_bkt) {
+				continue;
+			}
+			for (auto &ent : *old_bkt) {
+				auto &bkt_ref =
+					new_tab->bkts[_bucket_ix(*new_tab, _hash(ent.first))];
+				auto bkt = bkt_ref.load(std::memory_order_relaxed);
+				if (!bkt) {
+					bkt = new _bucket_t();
+					bkt_ref.store(bkt, std::memory_order_relaxed);
+				}
+				bkt->emplace_back(ent);
+			}
+		}
+		shd.tab.store(new_tab.release());
+		hazard_retire(old_tab);
+	}
+};
+
+} // namespace rua
+
+#endif
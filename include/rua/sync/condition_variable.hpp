@@ -0,0 +1,87 @@
+#ifndef _RUA_SYNC_CONDITION_VARIABLE_HPP
+#define _RUA_SYNC_CONDITION_VARIABLE_HPP
+
+#include "lockfree_list.hpp"
+#include "waiters.hpp"
+
+#include "../chrono/tick.hpp"
+#include "../sched/suspender.hpp"
+#include "../types/util.hpp"
+
+#include <cassert>
+
+namespace rua {
+
+// Works with any lock that has lock(suspender_i) and unlock(), such as
+// rua::mutex and rua::shared_mutex.
+class condition_variable {
+public:
+	constexpr condition_variable() : _waiters() {}
+
+	condition_variable(const condition_variable &) = delete;
+
+	condition_variable &operator=(const condition_variable &) = delete;
+
+	// Returns false on timeout, the lock is held again in both cases.
+	template <typename Lock>
+	bool wait(Lock &lck, duration timeout = duration_max()) {
+		return wait(lck, this_suspender(), timeout);
+	}
+
+	template <typename Lock>
+	bool wait(Lock &lck, suspender_i spdr, duration timeout = duration_max()) {
+		assert(spdr);
+
+		auto rsmr = spdr->get_resumer();
+		_waiters.emplace_front(rsmr);
+		lck.unlock();
+
+		auto r = !timeout || spdr->suspend(timeout);
+		if (_waiters.erase(rsmr)) {
+			r = false;
+		}
+
+		lck.lock(std::move(spdr));
+		return r;
+	}
+
+	template <typename Lock, typename Pred>
+	bool wait_until(Lock &lck, Pred &&pred, duration timeout = duration_max()) {
+		return wait_until(
+			lck, this_suspender(), std::forward<Pred>(pred), timeout);
+	}
+
+	template <typename Lock, typename Pred>
+	bool wait_until(
+		Lock &lck,
+		suspender_i spdr,
+		Pred &&pred,
+		duration timeout = duration_max()) {
+		while (!pred()) {
+			if (timeout <= 0) {
+				return false;
+			}
+			auto t = tick();
+			wait(lck, spdr, timeout);
+			if (timeout != duration_max()) {
+				timeout -= tick() - t;
+			}
+		}
+		return true;
+	}
+
+	void notify_one() {
+		_resume_one(_waiters);
+	}
+
+	void notify_all() {
+		_resume_all(_waiters);
+	}
+
+private:
+	lockfree_list<resumer_i> _waiters;
+};
+
+} // namespace rua
+
+#endif
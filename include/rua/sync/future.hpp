@@ -0,0 +1,148 @@
+#ifndef _RUA_SYNC_FUTURE_HPP
+#define _RUA_SYNC_FUTURE_HPP
+
+#include "lockfree_list.hpp"
+#include "waiters.hpp"
+
+#include "../optional.hpp"
+#include "../sched/suspender.hpp"
+#include "../types/traits.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+
+namespace rua {
+
+template <typename T>
+class promise;
+
+template <typename T>
+class future {
+public:
+	using value_t = conditional_t<std::is_void<T>::value, bool, T>;
+
+	constexpr future() = default;
+
+	explicit operator bool() const {
+		return _st.get();
+	}
+
+	// Also true when the promise was dropped without a value.
+	bool is_ready() const {
+		assert(_st);
+		return _st->is_done.load();
+	}
+
+	bool wait(duration timeout = duration_max()) {
+		return wait(this_suspender(), timeout);
+	}
+
+	bool wait(suspender_i spdr, duration timeout = duration_max()) {
+		assert(_st);
+
+		auto st = _st.get();
+		return _wait_until(
+			st->waiters,
+			[st]() -> bool { return st->is_done.load(); },
+			std::move(spdr),
+			timeout);
+	}
+
+	optional<value_t> try_get(duration timeout = 0) {
+		return try_get(this_suspender(), timeout);
+	}
+
+	optional<value_t> try_get(suspender_i spdr, duration timeout) {
+		optional<value_t> r;
+		if (!wait(std::move(spdr), timeout) || !_st->val) {
+			return r;
+		}
+		r.emplace(std::move(_st->val.value()));
+		_st->val.reset();
+		return r;
+	}
+
+	// The promise must not be dropped without a value, use try_get() when it
+	// can be.
+	T get() {
+		return get(this_suspender());
+	}
+
+	T get(suspender_i spdr) {
+		auto r = try_get(std::move(spdr), duration_max());
+		assert(r && "rua::future::get: broken promise");
+		return static_cast<T>(std::move(r.value()));
+	}
+
+private:
+	struct _state_t {
+		optional<value_t> val;
+		std::atomic<bool> is_done;
+		lockfree_list<resumer_i> waiters;
+
+		_state_t() : val(), is_done(false), waiters() {}
+	};
+
+	std::shared_ptr<_state_t> _st;
+
+	explicit future(std::shared_ptr<_state_t> st) : _st(std::move(st)) {}
+
+	friend promise<T>;
+};
+
+template <typename T>
+class promise {
+public:
+	promise() : _st(std::make_shared<typename future<T>::_state_t>()) {}
+
+	~promise() {
+		reset();
+	}
+
+	promise(promise &&src) : _st(std::move(src._st)) {}
+
+	RUA_OVERLOAD_ASSIGNMENT_R(promise)
+
+	explicit operator bool() const {
+		return _st.get();
+	}
+
+	future<T> get_future() const {
+		assert(_st);
+		return future<T>(_st);
+	}
+
+	template <typename... Args>
+	void set_value(Args &&...args) {
+		assert(_st);
+		assert(!_st->is_done.load());
+
+		_st->val.emplace(std::forward<Args>(args)...);
+		_done();
+	}
+
+	// Resolves the future without a value if it is still pending.
+	void reset() {
+		if (!_st) {
+			return;
+		}
+		if (!_st->is_done.load()) {
+			_done();
+		}
+		_st.reset();
+	}
+
+private:
+	std::shared_ptr<typename future<T>::_state_t> _st;
+
+	void _done() {
+		_st->is_done.store(true);
+		_resume_all(_st->waiters);
+	}
+};
+
+} // namespace rua
+
+#endif
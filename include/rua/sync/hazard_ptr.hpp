@@ -0,0 +1,230 @@
+#ifndef _RUA_SYNC_HAZARD_PTR_HPP
+#define _RUA_SYNC_HAZARD_PTR_HPP
+
+#include "../macros.hpp"
+#include "../types/util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#ifndef RUA_HAZARD_SLOT_COUNT
+#define RUA_HAZARD_SLOT_COUNT 8
+#endif
+
+namespace rua {
+
+// Every thread owns a record of hazard slots. Records are never freed, a
+// record released by an exited thread is reused with its retired pointers by
+// the next thread.
+
+struct _hazard_rec_t {
+	std::atomic<const void *> slots[RUA_HAZARD_SLOT_COUNT];
+	std::atomic<bool> is_used;
+	_hazard_rec_t *next;
+	size_t used_slot_mask;
+	std::vector<std::pair<void *, void (*)(void *)>> retireds;
+
+	// Reused by scans to keep them allocation-free.
+	std::vector<std::pair<void *, void (*)(void *)>> scanning_retireds;
+	std::vector<const void *> hzds;
+	bool is_scanning;
+
+	_hazard_rec_t() :
+		is_used(true), next(nullptr), used_slot_mask(0), is_scanning(false) {
+		for (auto &slot : slots) {
+			slot.store(nullptr);
+		}
+	}
+};
+
+inline std::atomic<_hazard_rec_t *> &_hazard_recs() {
+	static std::atomic<_hazard_rec_t *> front(nullptr);
+	return front;
+}
+
+inline std::atomic<size_t> &_hazard_rec_count() {
+	static std::atomic<size_t> c(0);
+	return c;
+}
+
+inline _hazard_rec_t *_acquire_hazard_rec() {
+	auto &front = _hazard_recs();
+	for (auto rec = front.load(); rec; rec = rec->next) {
+		auto is_used = false;
+		if (rec->is_used.compare_exchange_strong(is_used, true)) {
+			return rec;
+		}
+	}
+	auto rec = new _hazard_rec_t;
+	auto old_front = front.load();
+	do {
+		rec->next = old_front;
+	} while (!front.compare_exchange_weak(old_front, rec));
+	++_hazard_rec_count();
+	return rec;
+}
+
+inline void _hazard_scan(_hazard_rec_t &own) {
+	// Deleters may retire more pointers, they wait for the next scan.
+	if (own.is_scanning) {
+		return;
+	}
+	own.is_scanning = true;
+
+	auto &hzds = own.hzds;
+	hzds.clear();
+	for (auto rec = _hazard_recs().load(); rec; rec = rec->next) {
+		for (auto &slot : rec->slots) {
+			auto ptr = slot.load();
+			if (ptr) {
+				hzds.emplace_back(ptr);
+			}
+		}
+	}
+	std::sort(hzds.begin(), hzds.end());
+
+	auto &retireds = own.scanning_retireds;
+	retireds.swap(own.retireds);
+	for (auto &rtd : retireds) {
+		if (std::binary_search(
+				hzds.begin(), hzds.end(), static_cast<const void *>(rtd.first))) {
+			own.retireds.emplace_back(rtd);
+			continue;
+		}
+		rtd.second(rtd.first);
+	}
+	retireds.clear();
+
+	own.is_scanning = false;
+}
+
+inline void _release_hazard_rec(_hazard_rec_t &rec) {
+	for (auto &slot : rec.slots) {
+		slot.store(nullptr);
+	}
+	rec.used_slot_mask = 0;
+	if (rec.retireds.size()) {
+		_hazard_scan(rec);
+	}
+	rec.is_used.store(false);
+}
+
+// Set once the record of this thread is released, code that runs later in
+// the thread exit, such as thread_var destructors, uses temporary records.
+inline bool &_this_hazard_rec_closed() {
+	static thread_local bool is_closed = false;
+	return is_closed;
+}
+
+class _hazard_rec_holder {
+public:
+	_hazard_rec_holder() : _rec(_acquire_hazard_rec()) {}
+
+	~_hazard_rec_holder() {
+		_this_hazard_rec_closed() = true;
+		_release_hazard_rec(*_rec);
+	}
+
+	_hazard_rec_t &get() {
+		return *_rec;
+	}
+
+private:
+	_hazard_rec_t *_rec;
+};
+
+inline _hazard_rec_t &_this_hazard_rec() {
+	static thread_local _hazard_rec_holder hldr;
+	return hldr.get();
+}
+
+// Keeps the pointer it protects from being freed by hazard_retire() until it
+// is reset or destroyed.
+class hazard_ptr {
+public:
+	hazard_ptr() :
+		_is_temp(_this_hazard_rec_closed()),
+		_rec(_is_temp ? _acquire_hazard_rec() : &_this_hazard_rec()),
+		_ix(0) {
+		while (_rec->used_slot_mask & (static_cast<size_t>(1) << _ix)) {
+			++_ix;
+		}
+		assert(_ix < RUA_HAZARD_SLOT_COUNT);
+		_rec->used_slot_mask |= static_cast<size_t>(1) << _ix;
+	}
+
+	~hazard_ptr() {
+		reset();
+		_rec->used_slot_mask &= ~(static_cast<size_t>(1) << _ix);
+		if (_is_temp) {
+			_release_hazard_rec(*_rec);
+		}
+	}
+
+	hazard_ptr(const hazard_ptr &) = delete;
+
+	hazard_ptr &operator=(const hazard_ptr &) = delete;
+
+	// Loads src until the loaded pointer is published and still current.
+	template <typename T>
+	T *protect(const std::atomic<T *> &src) {
+		auto &slot = _rec->slots[_ix];
+		auto ptr = src.load();
+		for (;;) {
+			slot.store(ptr);
+			auto cur = src.load();
+			if (cur == ptr) {
+				return ptr;
+			}
+			ptr = cur;
+		}
+	}
+
+	// The caller must check that ptr is still reachable after this.
+	void reset(const void *ptr = nullptr) {
+		_rec->slots[_ix].store(ptr);
+	}
+
+private:
+	bool _is_temp;
+	_hazard_rec_t *_rec;
+	size_t _ix;
+};
+
+// Frees retired pointers of this thread that are not protected any more.
+inline void hazard_reclaim() {
+	if (_this_hazard_rec_closed()) {
+		_release_hazard_rec(*_acquire_hazard_rec());
+		return;
+	}
+	_hazard_scan(_this_hazard_rec());
+}
+
+// Frees ptr by del once no hazard_ptr protects it, retired pointers are
+// scanned in batches.
+inline void hazard_retire(void *ptr, void (*del)(void *)) {
+	if (_this_hazard_rec_closed()) {
+		auto &tmp = *_acquire_hazard_rec();
+		tmp.retireds.emplace_back(ptr, del);
+		_release_hazard_rec(tmp);
+		return;
+	}
+	auto &rec = _this_hazard_rec();
+	rec.retireds.emplace_back(ptr, del);
+	if (rec.retireds.size() >=
+		_hazard_rec_count().load() * RUA_HAZARD_SLOT_COUNT * 2 + 16) {
+		_hazard_scan(rec);
+	}
+}
+
+template <typename T>
+inline void hazard_retire(T *ptr) {
+	hazard_retire(ptr, [](void *p) { delete static_cast<T *>(p); });
+}
+
+} // namespace rua
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef _RUA_SYNC_LATCH_HPP
+#define _RUA_SYNC_LATCH_HPP
+
+#include "lockfree_list.hpp"
+#include "waiters.hpp"
+
+#include "../sched/suspender.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+
+namespace rua {
+
+class latch {
+public:
+	constexpr explicit latch(ptrdiff_t expected) :
+		_c(expected), _waiters() {}
+
+	latch(const latch &) = delete;
+
+	latch &operator=(const latch &) = delete;
+
+	void count_down(ptrdiff_t update = 1) {
+		auto c = _c -= update;
+		assert(c >= 0);
+		if (!c) {
+			_resume_all(_waiters);
+		}
+	}
+
+	bool try_wait() const {
+		return !_c.load();
+	}
+
+	bool wait(duration timeout = duration_max()) {
+		return wait(this_suspender(), timeout);
+	}
+
+	bool wait(suspender_i spdr, duration timeout = duration_max()) {
+		return _wait_until(
+			_waiters,
+			[this]() -> bool { return try_wait(); },
+			std::move(spdr),
+			timeout);
+	}
+
+	void arrive_and_wait(ptrdiff_t update = 1) {
+		count_down(update);
+		wait();
+	}
+
+private:
+	std::atomic<ptrdiff_t> _c;
+	lockfree_list<resumer_i> _waiters;
+};
+
+} // namespace rua
+
+#endif
@@ -48,6 +48,51 @@ make_lock_guard(Lock &lck, duration try_lock_timeout = duration_max()) {
 	return lock_guard<Lock>(lck, try_lock_timeout);
 }
 
+template <typename SharedLock>
+class shared_lock_guard {
+public:
+	explicit shared_lock_guard(
+		SharedLock &lck, duration try_lock_timeout = duration_max()) :
+		_lck(&lck) {
+		if (!_lck->try_lock_shared(try_lock_timeout)) {
+			_lck = nullptr;
+		}
+	}
+
+	~shared_lock_guard() {
+		unlock();
+	}
+
+	shared_lock_guard(shared_lock_guard &&src) : _lck(src._lck) {
+		if (src._lck) {
+			src._lck = nullptr;
+		}
+	}
+
+	RUA_OVERLOAD_ASSIGNMENT_R(shared_lock_guard)
+
+	explicit operator bool() const {
+		return _lck;
+	}
+
+	void unlock() {
+		if (!_lck) {
+			return;
+		}
+		_lck->unlock_shared();
+		_lck = nullptr;
+	}
+
+private:
+	SharedLock *_lck;
+};
+
+template <typename SharedLock>
+inline shared_lock_guard<SharedLock> make_shared_lock_guard(
+	SharedLock &lck, duration try_lock_timeout = duration_max()) {
+	return shared_lock_guard<SharedLock>(lck, try_lock_timeout);
+}
+
 } // namespace rua
 
 #endif
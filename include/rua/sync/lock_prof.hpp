@@ -0,0 +1,186 @@
+#ifndef _RUA_SYNC_LOCK_PROF_HPP
+#define _RUA_SYNC_LOCK_PROF_HPP
+
+// Contention profiling of mutex and chan, define RUA_LOCK_PROF to enable it.
+// Otherwise the hooks are compiled out.
+
+#ifdef RUA_LOCK_PROF
+
+#include "../chrono/duration.hpp"
+#include "../types/util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rua {
+
+struct lock_prof_stats {
+	// The name given at construction, objects sharing a name are summed up.
+	std::string name;
+
+	// Includes contended acquisitions.
+	uint64_t acquisitions;
+
+	// Acquisitions that had to wait. For a mutex it is
+	// mutex_stats::contentions, which also counts timed out waits.
+	uint64_t contended_acquisitions;
+
+	duration total_wait;
+	duration max_wait;
+};
+
+class lock_prof;
+
+struct _lock_prof_registry {
+	std::mutex mtx;
+	std::vector<lock_prof *> lives;
+	std::map<std::string, lock_prof_stats> deads;
+};
+
+// Never freed, locks in static storage may outlive other statics.
+inline _lock_prof_registry &_lock_profs() {
+	static auto reg = new _lock_prof_registry;
+	return *reg;
+}
+
+inline void
+_merge_lock_prof_stats(lock_prof_stats &to, const lock_prof_stats &from) {
+	to.acquisitions += from.acquisitions;
+	to.contended_acquisitions += from.contended_acquisitions;
+	to.total_wait += from.total_wait;
+	if (from.max_wait > to.max_wait) {
+		to.max_wait = from.max_wait;
+	}
+}
+
+// Registers itself on the first record, so the owner keeps a constexpr
+// constructor.
+//
+// An owner that already counts contentions passes its counter, which is then
+// reported instead of a second count.
+class lock_prof {
+public:
+	constexpr explicit lock_prof(
+		const char *name, const std::atomic<uint64_t> *contentions = nullptr) :
+		_name(name),
+		_is_registered(false),
+		_acq_c(0),
+		_cont_c(0),
+		_ext_cont_c(contentions),
+		_total_wait_ns(0),
+		_max_wait_ns(0) {}
+
+	~lock_prof() {
+		if (!_is_registered.load()) {
+			return;
+		}
+		auto &reg = _lock_profs();
+		std::lock_guard<std::mutex> lg(reg.mtx);
+		reg.lives.erase(std::find(reg.lives.begin(), reg.lives.end(), this));
+		auto st = stats();
+		auto it = reg.deads.find(st.name);
+		if (it == reg.deads.end()) {
+			reg.deads.emplace(st.name, std::move(st));
+			return;
+		}
+		_merge_lock_prof_stats(it->second, st);
+	}
+
+	lock_prof(const lock_prof &) = delete;
+
+	lock_prof &operator=(const lock_prof &) = delete;
+
+	void record() {
+		_register();
+		_acq_c.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void record(duration wait) {
+		_register();
+		_acq_c.fetch_add(1, std::memory_order_relaxed);
+		if (!_ext_cont_c) {
+			_cont_c.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		auto ns = wait.nanoseconds();
+		_total_wait_ns.fetch_add(ns, std::memory_order_relaxed);
+		auto max_ns = _max_wait_ns.load(std::memory_order_relaxed);
+		while (ns > max_ns && !_max_wait_ns.compare_exchange_weak(
+								  max_ns, ns, std::memory_order_relaxed))
+			;
+	}
+
+	lock_prof_stats stats() const {
+		return {
+			_name,
+			_acq_c.load(std::memory_order_relaxed),
+			(_ext_cont_c ? *_ext_cont_c : _cont_c)
+				.load(std::memory_order_relaxed),
+			nanoseconds(_total_wait_ns.load(std::memory_order_relaxed)),
+			nanoseconds(_max_wait_ns.load(std::memory_order_relaxed))};
+	}
+
+private:
+	const char *_name;
+	std::atomic<bool> _is_registered;
+	std::atomic<uint64_t> _acq_c, _cont_c;
+	const std::atomic<uint64_t> *_ext_cont_c;
+	std::atomic<int64_t> _total_wait_ns, _max_wait_ns;
+
+	void _register() {
+		if (_is_registered.load(std::memory_order_relaxed) ||
+			_is_registered.exchange(true)) {
+			return;
+		}
+		auto &reg = _lock_profs();
+		std::lock_guard<std::mutex> lg(reg.mtx);
+		reg.lives.emplace_back(this);
+	}
+};
+
+// Returns the stats of all profiled objects, including destroyed ones, sorted
+// by total wait time in descending order.
+inline std::vector<lock_prof_stats> lock_prof_report() {
+	std::map<std::string, lock_prof_stats> sums;
+	{
+		auto &reg = _lock_profs();
+		std::lock_guard<std::mutex> lg(reg.mtx);
+		sums = reg.deads;
+		for (auto prof : reg.lives) {
+			auto st = prof->stats();
+			auto it = sums.find(st.name);
+			if (it == sums.end()) {
+				sums.emplace(st.name, std::move(st));
+				continue;
+			}
+			_merge_lock_prof_stats(it->second, st);
+		}
+	}
+
+	std::vector<lock_prof_stats> rpt;
+	rpt.reserve(sums.size());
+	for (auto &pr : sums) {
+		rpt.emplace_back(std::move(pr.second));
+	}
+	std::sort(
+		rpt.begin(),
+		rpt.end(),
+		[](const lock_prof_stats &a, const lock_prof_stats &b) -> bool {
+			if (a.total_wait != b.total_wait) {
+				return a.total_wait > b.total_wait;
+			}
+			return a.contended_acquisitions > b.contended_acquisitions;
+		});
+	return rpt;
+}
+
+} // namespace rua
+
+#endif
+
+#endif
@@ -200,6 +200,30 @@ public:
 		return r;
 	}
 
+	bool erase(const T &val) {
+		auto li = lock_if_non_empty();
+		if (!li) {
+			return false;
+		}
+		auto r = false;
+		if (li.front() == val) {
+			li.erase_front();
+			r = true;
+		} else {
+			for (auto before = li.begin(); before.node()->after;
+				 before = typename forward_list<T>::iterator(
+					 before.node()->after)) {
+				if (before.node()->after->value == val) {
+					li.erase_after(before);
+					r = true;
+					break;
+				}
+			}
+		}
+		unlock_and_prepend(std::move(li));
+		return r;
+	}
+
 	forward_list<T> pop_all() {
 		auto front = _front.load();
 		do {
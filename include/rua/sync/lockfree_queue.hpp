@@ -0,0 +1,177 @@
+#ifndef _RUA_SYNC_LOCKFREE_QUEUE_HPP
+#define _RUA_SYNC_LOCKFREE_QUEUE_HPP
+
+#include "hazard_ptr.hpp"
+
+#include "../macros.hpp"
+#include "../node_pool.hpp"
+#include "../optional.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+namespace rua {
+
+// Michael-Scott queue, O(1) enqueue and dequeue without a global lock.
+//
+// The dummy node is allocated by the first enqueue, so the constructor is
+// constexpr and static queues are constant initialized.
+template <typename T>
+class lockfree_queue {
+public:
+	constexpr lockfree_queue() : _head(nullptr), _pad(), _tail(nullptr) {}
+
+	~lockfree_queue() {
+		while (pop()) {
+		}
+		delete _head.load();
+	}
+
+	lockfree_queue(const lockfree_queue &) = delete;
+
+	lockfree_queue &operator=(const lockfree_queue &) = delete;
+
+	operator bool() const {
+		return !empty();
+	}
+
+	bool empty() const {
+		hazard_ptr hp;
+		auto head = hp.protect(_head);
+		return !head || !head->next.load();
+	}
+
+	template <typename... Args>
+	void emplace(Args &&...args) {
+		auto node = _new_node(std::forward<Args>(args)...);
+		_link(node, node);
+	}
+
+	// Links all values with a single CAS, returns the number of values.
+	template <typename InputIt>
+	size_t emplace_many(InputIt first, InputIt last) {
+		if (first == last) {
+			return 0;
+		}
+		auto front = _new_node(*first);
+		auto back = front;
+		size_t n = 1;
+		for (++first; first != last; ++first, ++n) {
+			auto node = _new_node(*first);
+			back->next.store(node, std::memory_order_relaxed);
+			back = node;
+		}
+		_link(front, back);
+		return n;
+	}
+
+	optional<T> pop() {
+		optional<T> r;
+		hazard_ptr head_hp, next_hp;
+		for (;;) {
+			auto head = head_hp.protect(_head);
+			if (!head) {
+				break;
+			}
+			auto tail = _tail.load();
+			if (!tail) {
+				// The tail must not lag behind the head.
+				_init_tail();
+				continue;
+			}
+			auto next = head->next.load();
+			next_hp.reset(next);
+			if (head != _head.load()) {
+				continue;
+			}
+			if (!next) {
+				break;
+			}
+			if (head == tail) {
+				_tail.compare_exchange_weak(tail, next);
+				continue;
+			}
+			if (_head.compare_exchange_weak(head, next)) {
+				// The next node is the new dummy, its value belongs to us.
+				auto val_ptr = reinterpret_cast<T *>(&next->sto);
+				r.emplace(std::move(*val_ptr));
+				val_ptr->~T();
+				head_hp.reset();
+				hazard_retire(head);
+				return r;
+			}
+		}
+		return r;
+	}
+
+private:
+	struct _node_t {
+		std::atomic<_node_t *> next;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type sto;
+
+		_node_t() : next(nullptr) {}
+
+		static void *operator new(size_t) {
+			return node_pool<sizeof(_node_t), alignof(_node_t)>::alloc();
+		}
+
+		static void operator delete(void *ptr) {
+			node_pool<sizeof(_node_t), alignof(_node_t)>::free(ptr);
+		}
+	};
+
+	std::atomic<_node_t *> _head;
+	char _pad[RUA_CACHE_LINE_SIZE - sizeof(std::atomic<_node_t *>)];
+	std::atomic<_node_t *> _tail;
+
+	template <typename... Args>
+	static _node_t *_new_node(Args &&...args) {
+		auto node = new _node_t;
+		new (&node->sto) T(std::forward<Args>(args)...);
+		return node;
+	}
+
+	// Installs the dummy node as the head, then publishes it as the tail. Any
+	// thread that sees the head without the tail helps to publish it.
+	void _init_tail() {
+		auto head = _head.load();
+		if (!head) {
+			auto dummy = new _node_t;
+			if (_head.compare_exchange_strong(head, dummy)) {
+				head = dummy;
+			} else {
+				delete dummy;
+			}
+		}
+		_node_t *tail = nullptr;
+		_tail.compare_exchange_strong(tail, head);
+	}
+
+	void _link(_node_t *front, _node_t *back) {
+		if (!_tail.load()) {
+			_init_tail();
+		}
+		hazard_ptr hp;
+		for (;;) {
+			auto tail = hp.protect(_tail);
+			auto next = tail->next.load();
+			if (tail != _tail.load()) {
+				continue;
+			}
+			if (next) {
+				_tail.compare_exchange_weak(tail, next);
+				continue;
+			}
+			if (tail->next.compare_exchange_weak(next, front)) {
+				_tail.compare_exchange_strong(tail, back);
+				break;
+			}
+		}
+	}
+};
+
+} // namespace rua
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef _RUA_SYNC_LOCKFREE_STACK_HPP
+#define _RUA_SYNC_LOCKFREE_STACK_HPP
+
+#include "hazard_ptr.hpp"
+
+#include "../node_pool.hpp"
+#include "../optional.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <utility>
+
+namespace rua {
+
+// Treiber stack, popped nodes are reclaimed by hazard pointers.
+template <typename T>
+class lockfree_stack {
+public:
+	constexpr lockfree_stack() : _top(nullptr) {}
+
+	~lockfree_stack() {
+		auto node = _top.exchange(nullptr);
+		while (node) {
+			auto n = node;
+			node = node->next;
+			delete n;
+		}
+	}
+
+	lockfree_stack(const lockfree_stack &) = delete;
+
+	lockfree_stack &operator=(const lockfree_stack &) = delete;
+
+	operator bool() const {
+		return _top.load();
+	}
+
+	bool empty() const {
+		return !_top.load();
+	}
+
+	template <typename... Args>
+	void emplace(Args &&...args) {
+		auto node = new _node_t(std::forward<Args>(args)...);
+		node->next = _top.load();
+		while (!_top.compare_exchange_weak(node->next, node))
+			;
+	}
+
+	optional<T> pop() {
+		optional<T> r;
+		hazard_ptr hp;
+		for (;;) {
+			auto top = hp.protect(_top);
+			if (!top) {
+				return r;
+			}
+			if (_top.compare_exchange_weak(top, top->next)) {
+				r.emplace(std::move(top->value));
+				hp.reset();
+				hazard_retire(top);
+				return r;
+			}
+		}
+	}
+
+private:
+	struct _node_t {
+		T value;
+		_node_t *next;
+
+		template <typename... Args>
+		_node_t(Args &&...args) :
+			value(std::forward<Args>(args)...), next(nullptr) {}
+
+		static void *operator new(size_t) {
+			return node_pool<sizeof(_node_t), alignof(_node_t)>::alloc();
+		}
+
+		static void operator delete(void *ptr) {
+			node_pool<sizeof(_node_t), alignof(_node_t)>::free(ptr);
+		}
+	};
+
+	std::atomic<_node_t *> _top;
+};
+
+} // namespace rua
+
+#endif
@@ -1,33 +1,83 @@
 #ifndef _RUA_SYNC_MUTEX_HPP
 #define _RUA_SYNC_MUTEX_HPP
 
+#include "backoff.hpp"
+#include "lock_prof.hpp"
 #include "lockfree_list.hpp"
 
 #include "../chrono/tick.hpp"
+#include "../macros.hpp"
 #include "../sched/suspender.hpp"
 #include "../types/util.hpp"
 
 #include <atomic>
 #include <cassert>
+#include <cstdint>
 
 namespace rua {
 
+struct _coro_access;
+
+enum class mutex_handoff {
+	// unlock() passes ownership to the oldest waiter.
+	fifo,
+
+	// unlock() releases the lock and wakes the oldest waiter, which competes
+	// with other lockers again.
+	barging
+};
+
+struct mutex_stats {
+	// try_lock() with a timeout found the lock held. With RUA_LOCK_PROF it is
+	// also reported as lock_prof_stats::contended_acquisitions.
+	std::atomic<uint64_t> contentions;
+
+	// Contended locks acquired while spinning.
+	std::atomic<uint64_t> spin_acquisitions;
+
+	// Suspensions of waiters.
+	std::atomic<uint64_t> parks;
+
+	constexpr mutex_stats() : contentions(0), spin_acquisitions(0), parks(0) {}
+};
+
 class mutex {
 public:
-	constexpr mutex() : _locked(0), _waiters() {}
+	constexpr mutex() : mutex("rua::mutex") {}
+
+	constexpr explicit mutex(mutex_handoff handoff, size_t max_spin_c = 100) :
+		mutex("rua::mutex", handoff, max_spin_c) {}
+
+	// The name identifies the mutex in lock_prof_report().
+	constexpr explicit mutex(
+		RUA_MAYBE_UNUSED const char *name,
+		mutex_handoff handoff = mutex_handoff::fifo,
+		size_t max_spin_c = 100) :
+		_locked(0),
+		_waiters(),
+		_handoff(handoff),
+		_max_spin_c(max_spin_c),
+		_spin_avg(0),
+		_stats()
+#ifdef RUA_LOCK_PROF
+		,
+		_prof(name, &_stats.contentions)
+#endif
+	{
+	}
 
 	mutex(const mutex &) = delete;
 
 	mutex &operator=(const mutex &) = delete;
 
 	bool try_lock() {
-		auto old_locked = _locked.load();
-		while (!old_locked) {
-			if (_locked.compare_exchange_weak(old_locked, nmax<uintptr_t>())) {
-				return true;
-			}
+		if (!_try_lock()) {
+			return false;
 		}
-		return false;
+#ifdef RUA_LOCK_PROF
+		_prof.record();
+#endif
+		return true;
 	}
 
 	bool try_lock(duration timeout) {
@@ -59,6 +109,19 @@ public:
 	}
 
 	void unlock() {
+		if (_handoff == mutex_handoff::barging) {
+#ifdef NDEBUG
+			_locked.store(0);
+#else
+			assert(_locked.exchange(0));
+#endif
+			auto waiter_opt = _waiters.pop_back();
+			if (waiter_opt) {
+				waiter_opt.value()->resume();
+			}
+			return;
+		}
+
 		auto waiters = _waiters.lock();
 		if (waiters.empty()) {
 #ifdef NDEBUG
@@ -79,55 +142,137 @@ public:
 		waiter->resume();
 	}
 
+	const mutex_stats &stats() const {
+		return _stats;
+	}
+
 private:
 	std::atomic<uintptr_t> _locked;
 	lockfree_list<resumer_i> _waiters;
+	mutex_handoff _handoff;
+	size_t _max_spin_c;
+	std::atomic<size_t> _spin_avg;
+	mutex_stats _stats;
+#ifdef RUA_LOCK_PROF
+	lock_prof _prof;
+#endif
+
+	bool _try_lock() {
+		auto old_locked = _locked.load();
+		while (!old_locked) {
+			if (_locked.compare_exchange_weak(old_locked, nmax<uintptr_t>())) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Spinning only pays off when the owner runs on another thread, so
+	// suspenders sharing a thread with the owner (such as fibers) park at once.
+	// The spin limit adapts to how long recent spins took to succeed.
+	bool _spin_and_lock() {
+		if (!_max_spin_c) {
+			return false;
+		}
+
+		auto avg = _spin_avg.load(std::memory_order_relaxed);
+		auto spin_c = avg * 2 + 10;
+		if (spin_c > _max_spin_c) {
+			spin_c = _max_spin_c;
+		}
+
+		backoff bo;
+		for (size_t i = 0; i < spin_c; ++i) {
+			// Do not overtake parked waiters in FIFO mode.
+			if (_handoff == mutex_handoff::fifo && !_waiters.empty()) {
+				break;
+			}
+			if (!_locked.load(std::memory_order_relaxed) && _try_lock()) {
+				_update_spin_avg(avg, i);
+				++_stats.spin_acquisitions;
+				return true;
+			}
+			bo.pause();
+		}
+		_update_spin_avg(avg, spin_c);
+		return false;
+	}
+
+	void _update_spin_avg(size_t avg, size_t spun_c) {
+		auto dif = static_cast<intptr_t>(spun_c) - static_cast<intptr_t>(avg);
+		_spin_avg.store(
+			static_cast<size_t>(static_cast<intptr_t>(avg) + dif / 8),
+			std::memory_order_relaxed);
+	}
 
 	bool _wait_and_lock(suspender_i spdr, duration timeout) {
+#ifdef RUA_LOCK_PROF
+		auto t = tick();
+		if (!_wait_and_lock_raw(std::move(spdr), timeout)) {
+			return false;
+		}
+		_prof.record(tick() - t);
+		return true;
+#else
+		return _wait_and_lock_raw(std::move(spdr), timeout);
+#endif
+	}
+
+	bool _wait_and_lock_raw(suspender_i spdr, duration timeout) {
 		assert(spdr);
 		assert(timeout);
 
-		auto rsmr = spdr->get_resumer();
-		auto rsmr_id = reinterpret_cast<uintptr_t>(rsmr.get());
+		++_stats.contentions;
 
-		if (!_waiters.emplace_front_if(
-				[this, rsmr_id]() -> bool { return _locked.load() != rsmr_id; },
-				rsmr)) {
+		if (spdr->is_own_stack() && _spin_and_lock()) {
 			return true;
 		}
 
-		if (timeout == duration_max()) {
-			for (;;) {
-				if (spdr->suspend(timeout) && (_locked.load() == rsmr_id ||
-											  !_waiters.emplace_front_if(
-												  [this, rsmr_id]() -> bool {
-													  return _locked.load() !=
-															 rsmr_id;
-												  },
-												  rsmr))) {
-					return true;
-				}
-			}
-		}
+		auto rsmr = spdr->get_resumer();
+		auto rsmr_id = reinterpret_cast<uintptr_t>(rsmr.get());
+		auto is_fifo = _handoff == mutex_handoff::fifo;
 
 		for (;;) {
+			if (!_waiters.emplace_front_if(
+					[&]() -> bool {
+						return !(
+							(is_fifo && _locked.load() == rsmr_id) ||
+							_try_lock());
+					},
+					rsmr)) {
+				return true;
+			}
+
+			++_stats.parks;
+
 			auto t = tick();
-			auto r = spdr->suspend(timeout);
-			timeout -= tick() - t;
-			if (timeout <= 0) {
-				return _locked.load() == rsmr_id;
+			spdr->suspend(timeout);
+			if (timeout != duration_max()) {
+				timeout -= tick() - t;
 			}
-			if (r && (_locked.load() == rsmr_id ||
-					  !_waiters.emplace_front_if(
-						  [this, rsmr_id]() -> bool {
-							  return _locked.load() != rsmr_id;
-						  },
-						  rsmr))) {
+
+			if (is_fifo && _locked.load() == rsmr_id) {
 				return true;
 			}
+			if (!_waiters.erase(rsmr)) {
+				// Popped by unlock(), in FIFO mode the ownership is on its way.
+				if (is_fifo) {
+					while (_locked.load() != rsmr_id) {
+						cpu_pause();
+					}
+					return true;
+				}
+			}
+			if (timeout <= 0) {
+				return _try_lock();
+			}
+
+			rsmr = spdr->get_resumer();
 		}
 		return false;
 	}
+
+	friend _coro_access;
 };
 
 } // namespace rua
@@ -0,0 +1,145 @@
+#ifndef _RUA_SYNC_SELECT_HPP
+#define _RUA_SYNC_SELECT_HPP
+
+#include "bounded_chan.hpp"
+#include "chan.hpp"
+#include "lockfree_list.hpp"
+#include "spsc_chan.hpp"
+#include "waiters.hpp"
+
+#include "../chrono/tick.hpp"
+#include "../optional.hpp"
+#include "../sched/suspender.hpp"
+#include "../types/util.hpp"
+
+namespace rua {
+
+struct _select_access {
+	template <typename T>
+	static lockfree_list<resumer_i> &waiters(chan<T> &ch) {
+		return ch._waiters;
+	}
+
+	template <typename T>
+	static lockfree_list<resumer_i> &waiters(bounded_chan<T> &ch) {
+		return ch._recv_waiters;
+	}
+
+	template <typename T>
+	static lockfree_list<resumer_i> &waiters(spsc_chan<T> &ch) {
+		return ch._recv_waiters;
+	}
+};
+
+struct _select_case_t {
+	lockfree_list<resumer_i> *waiters;
+	const void *ch;
+	bool (*is_empty)(const void *);
+	bool is_registered;
+};
+
+template <typename Chan>
+inline _select_case_t _make_select_case(Chan &ch) {
+	return {
+		&_select_access::waiters(ch),
+		&ch,
+		[](const void *p) -> bool {
+			return static_cast<const Chan *>(p)->empty();
+		},
+		false};
+}
+
+inline optional<size_t> _select_ready(_select_case_t *cases, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		if (!cases[i].is_empty(cases[i].ch)) {
+			return i;
+		}
+	}
+	return nullopt;
+}
+
+inline void _select_unregister(
+	_select_case_t *cases,
+	size_t n,
+	const resumer_i &rsmr,
+	const optional<size_t> &picked) {
+	for (size_t i = 0; i < n; ++i) {
+		auto &cs = cases[i];
+		if (!cs.is_registered) {
+			continue;
+		}
+		cs.is_registered = false;
+		if (cs.waiters->erase(rsmr)) {
+			continue;
+		}
+		// The wakeup of this channel was consumed here, pass it on.
+		if ((!picked || picked.value() != i) && !cs.is_empty(cs.ch)) {
+			_resume_one(*cs.waiters);
+		}
+	}
+}
+
+inline optional<size_t> _try_select(
+	_select_case_t *cases, size_t n, suspender_i spdr, duration timeout) {
+	auto r = _select_ready(cases, n);
+	if (r || !timeout || !spdr) {
+		return r;
+	}
+
+	for (;;) {
+		auto rsmr = spdr->get_resumer();
+		for (size_t i = 0; i < n; ++i) {
+			auto &cs = cases[i];
+			if (!cs.waiters->emplace_front_if(
+					[&]() -> bool { return cs.is_empty(cs.ch); }, rsmr)) {
+				r.emplace(i);
+				break;
+			}
+			cs.is_registered = true;
+		}
+
+		if (!r) {
+			auto t = tick();
+			spdr->suspend(timeout);
+			if (timeout != duration_max()) {
+				timeout -= tick() - t;
+			}
+			r = _select_ready(cases, n);
+		}
+
+		_select_unregister(cases, n, rsmr, r);
+
+		if (r || timeout <= 0) {
+			return r;
+		}
+	}
+}
+
+// Waits until one of the channels has a value and returns its index, the value
+// is not taken, so the caller should try_pop() the channel, which may still
+// fail if another consumer was faster.
+template <typename... Chans>
+inline optional<size_t>
+try_select(suspender_i spdr, duration timeout, Chans &...chs) {
+	_select_case_t cases[] = {_make_select_case(chs)...};
+	return _try_select(cases, sizeof...(Chans), std::move(spdr), timeout);
+}
+
+template <typename... Chans>
+inline optional<size_t> try_select(duration timeout, Chans &...chs) {
+	return try_select(this_suspender(), timeout, chs...);
+}
+
+template <typename... Chans>
+inline size_t select(suspender_i spdr, Chans &...chs) {
+	return try_select(std::move(spdr), duration_max(), chs...).value();
+}
+
+template <typename... Chans>
+inline size_t select(Chans &...chs) {
+	return try_select(this_suspender(), duration_max(), chs...).value();
+}
+
+} // namespace rua
+
+#endif
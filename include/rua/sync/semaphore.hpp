@@ -0,0 +1,74 @@
+#ifndef _RUA_SYNC_SEMAPHORE_HPP
+#define _RUA_SYNC_SEMAPHORE_HPP
+
+#include "lockfree_list.hpp"
+#include "waiters.hpp"
+
+#include "../sched/suspender.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+
+namespace rua {
+
+class counting_semaphore {
+public:
+	constexpr explicit counting_semaphore(ptrdiff_t desired = 0) :
+		_c(desired), _waiters() {}
+
+	counting_semaphore(const counting_semaphore &) = delete;
+
+	counting_semaphore &operator=(const counting_semaphore &) = delete;
+
+	ptrdiff_t count() const {
+		return _c.load();
+	}
+
+	bool try_acquire() {
+		auto old_c = _c.load();
+		while (old_c > 0) {
+			if (_c.compare_exchange_weak(old_c, old_c - 1)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool try_acquire(duration timeout) {
+		return try_acquire(this_suspender(), timeout);
+	}
+
+	bool try_acquire(suspender_i spdr, duration timeout) {
+		return _wait_until(
+			_waiters,
+			[this]() -> bool { return try_acquire(); },
+			std::move(spdr),
+			timeout);
+	}
+
+	void acquire() {
+		try_acquire(duration_max());
+	}
+
+	void acquire(suspender_i spdr) {
+		try_acquire(std::move(spdr), duration_max());
+	}
+
+	void release(ptrdiff_t update = 1) {
+		assert(update >= 0);
+
+		_c += update;
+		while (update-- && !_waiters.empty() && _resume_one(_waiters))
+			;
+	}
+
+private:
+	std::atomic<ptrdiff_t> _c;
+	lockfree_list<resumer_i> _waiters;
+};
+
+} // namespace rua
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef _RUA_SYNC_SHARED_MUTEX_HPP
+#define _RUA_SYNC_SHARED_MUTEX_HPP
+
+#include "lockfree_list.hpp"
+#include "mutex.hpp"
+#include "waiters.hpp"
+
+#include "../chrono/tick.hpp"
+#include "../macros.hpp"
+#include "../sched/suspender.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+namespace rua {
+
+#ifndef RUA_SHARED_MUTEX_SLOT_COUNT
+#define RUA_SHARED_MUTEX_SLOT_COUNT 16
+#endif
+
+inline size_t _shared_mutex_slot_ix() {
+	static std::atomic<size_t> next_ix(0);
+	static thread_local size_t ix = next_ix++ % RUA_SHARED_MUTEX_SLOT_COUNT;
+	return ix;
+}
+
+// Readers count themselves in one of several cache-line sized slots, so they
+// do not contend with each other. Pending writers block new readers.
+class shared_mutex {
+public:
+	constexpr shared_mutex() :
+		_slots(), _wr_c(0), _wr_mtx(), _rd_waiters(), _wr_waiters() {}
+
+	shared_mutex(const shared_mutex &) = delete;
+
+	shared_mutex &operator=(const shared_mutex &) = delete;
+
+	bool try_lock() {
+		return _lock(nullptr, 0);
+	}
+
+	bool try_lock(duration timeout) {
+		return _lock(this_suspender(), timeout);
+	}
+
+	bool try_lock(suspender_i spdr, duration timeout) {
+		return _lock(std::move(spdr), timeout);
+	}
+
+	void lock() {
+		_lock(this_suspender(), duration_max());
+	}
+
+	void lock(suspender_i spdr) {
+		_lock(std::move(spdr), duration_max());
+	}
+
+	void unlock() {
+		_wr_mtx.unlock();
+		_drop_writer();
+	}
+
+	bool try_lock_shared() {
+		if (_wr_c.load()) {
+			return false;
+		}
+		auto &c = _slots[_shared_mutex_slot_ix()].c;
+		++c;
+		if (!_wr_c.load()) {
+			return true;
+		}
+		--c;
+		_resume_one(_wr_waiters);
+		return false;
+	}
+
+	bool try_lock_shared(duration timeout) {
+		return try_lock_shared(this_suspender(), timeout);
+	}
+
+	bool try_lock_shared(suspender_i spdr, duration timeout) {
+		return _wait_until(
+			_rd_waiters,
+			[this]() -> bool { return try_lock_shared(); },
+			std::move(spdr),
+			timeout);
+	}
+
+	void lock_shared() {
+		try_lock_shared(duration_max());
+	}
+
+	void lock_shared(suspender_i spdr) {
+		try_lock_shared(std::move(spdr), duration_max());
+	}
+
+	void unlock_shared() {
+		--_slots[_shared_mutex_slot_ix()].c;
+		if (_wr_c.load()) {
+			_resume_one(_wr_waiters);
+		}
+	}
+
+private:
+	struct _slot_t {
+		std::atomic<intptr_t> c;
+		char pad[RUA_CACHE_LINE_SIZE - sizeof(std::atomic<intptr_t>)];
+
+		constexpr _slot_t() : c(0), pad() {}
+	};
+
+	_slot_t _slots[RUA_SHARED_MUTEX_SLOT_COUNT];
+	std::atomic<size_t> _wr_c;
+	mutex _wr_mtx;
+	lockfree_list<resumer_i> _rd_waiters, _wr_waiters;
+
+	intptr_t _reader_count() const {
+		intptr_t c = 0;
+		for (auto &slot : _slots) {
+			c += slot.c.load();
+		}
+		return c;
+	}
+
+	bool _lock(suspender_i spdr, duration timeout) {
+		++_wr_c;
+
+		auto t = tick();
+		if (!_wr_mtx.try_lock(spdr, timeout)) {
+			_drop_writer();
+			return false;
+		}
+		if (timeout != duration_max()) {
+			timeout -= tick() - t;
+			if (timeout < 0) {
+				timeout = 0;
+			}
+		}
+
+		if (!_wait_until(
+				_wr_waiters,
+				[this]() -> bool { return !_reader_count(); },
+				std::move(spdr),
+				timeout)) {
+			_wr_mtx.unlock();
+			_drop_writer();
+			return false;
+		}
+		return true;
+	}
+
+	void _drop_writer() {
+		if (!--_wr_c) {
+			_resume_all(_rd_waiters);
+		}
+	}
+};
+
+} // namespace rua
+
+#endif
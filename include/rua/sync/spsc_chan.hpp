@@ -0,0 +1,228 @@
+#ifndef _RUA_SYNC_SPSC_CHAN_HPP
+#define _RUA_SYNC_SPSC_CHAN_HPP
+
+#include "lockfree_list.hpp"
+#include "waiters.hpp"
+
+#include "../macros.hpp"
+#include "../optional.hpp"
+#include "../sched/suspender.hpp"
+#include "../types/util.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace rua {
+
+struct _select_access;
+
+// Bounded ring for exactly one sender and one receiver. Each side keeps a
+// cached copy of the other side's index and only reloads it when the ring
+// looks full or empty, so the shared indexes are rarely touched.
+template <typename T>
+class spsc_chan {
+public:
+	explicit spsc_chan(size_t capacity) :
+		_mask(_round_up(capacity) - 1),
+		_cels(new _cell_t[_mask + 1]),
+		_tail(0),
+		_head_cache(0),
+		_head(0),
+		_tail_cache(0) {}
+
+	~spsc_chan() {
+		optional<T> val_opt;
+		while (_pop_raw(val_opt)) {
+			val_opt.reset();
+		}
+	}
+
+	spsc_chan(const spsc_chan &) = delete;
+
+	spsc_chan &operator=(const spsc_chan &) = delete;
+
+	size_t capacity() const {
+		return _mask + 1;
+	}
+
+	bool empty() const {
+		return _head.load() == _tail.load();
+	}
+
+	template <typename... Args>
+	bool try_emplace(Args &&...args) {
+		if (!_emplace_raw(std::forward<Args>(args)...)) {
+			return false;
+		}
+		_notify(_recv_waiters);
+		return true;
+	}
+
+	template <typename... Args>
+	void emplace(Args &&...args) {
+		if (try_emplace(std::forward<Args>(args)...)) {
+			return;
+		}
+		_wait_and_emplace(
+			this_suspender(), duration_max(), std::forward<Args>(args)...);
+	}
+
+	bool try_push(T val, duration timeout) {
+		if (try_emplace(std::move(val))) {
+			return true;
+		}
+		return _wait_and_emplace(this_suspender(), timeout, std::move(val));
+	}
+
+	bool try_push(suspender_i spdr, T val, duration timeout) {
+		return _wait_and_emplace(std::move(spdr), timeout, std::move(val));
+	}
+
+	void push(T val) {
+		emplace(std::move(val));
+	}
+
+	void push(suspender_i spdr, T val) {
+		_wait_and_emplace(std::move(spdr), duration_max(), std::move(val));
+	}
+
+	optional<T> try_pop() {
+		optional<T> val_opt;
+		if (_pop_raw(val_opt)) {
+			_notify(_send_waiters);
+		}
+		return val_opt;
+	}
+
+	optional<T> try_pop(duration timeout) {
+		auto val_opt = try_pop();
+		if (val_opt || !timeout) {
+			return val_opt;
+		}
+		return try_pop(this_suspender(), timeout);
+	}
+
+	optional<T> try_pop(suspender_i spdr, duration timeout) {
+		optional<T> val_opt;
+		if (_wait_until(
+				_recv_waiters,
+				[&]() -> bool { return _pop_raw(val_opt); },
+				std::move(spdr),
+				timeout)) {
+			_notify(_send_waiters);
+		}
+		return val_opt;
+	}
+
+	T pop() {
+		return try_pop(duration_max()).value();
+	}
+
+	T pop(suspender_i spdr) {
+		return try_pop(std::move(spdr), duration_max()).value();
+	}
+
+private:
+	struct _cell_t {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type sto;
+	};
+
+	const size_t _mask;
+	std::unique_ptr<_cell_t[]> _cels;
+
+	// Written by the sender.
+	char _pad0[RUA_CACHE_LINE_SIZE];
+	std::atomic<size_t> _tail;
+	size_t _head_cache;
+	lockfree_list<resumer_i> _send_waiters;
+
+	// Written by the receiver.
+	char _pad1[RUA_CACHE_LINE_SIZE];
+	std::atomic<size_t> _head;
+	size_t _tail_cache;
+	lockfree_list<resumer_i> _recv_waiters;
+	char _pad2[RUA_CACHE_LINE_SIZE];
+
+	static size_t _round_up(size_t n) {
+		size_t r = 2;
+		while (r < n) {
+			r <<= 1;
+		}
+		return r;
+	}
+
+	// The reloads are sequentially consistent, so they pair with the fence in
+	// _notify() when evaluated under the lock of a waiter list.
+
+	template <typename... Args>
+	bool _emplace_raw(Args &&...args) {
+		auto tail = _tail.load(std::memory_order_relaxed);
+		if (tail - _head_cache > _mask) {
+			_head_cache = _head.load();
+			if (tail - _head_cache > _mask) {
+				return false;
+			}
+		}
+		new (&_cels[tail & _mask].sto) T(std::forward<Args>(args)...);
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool _pop_raw(optional<T> &val_opt) {
+		auto head = _head.load(std::memory_order_relaxed);
+		if (head == _tail_cache) {
+			_tail_cache = _tail.load();
+			if (head == _tail_cache) {
+				return false;
+			}
+		}
+		auto val_ptr = reinterpret_cast<T *>(&_cels[head & _mask].sto);
+		val_opt.emplace(std::move(*val_ptr));
+		val_ptr->~T();
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	static void _notify(lockfree_list<resumer_i> &waiters) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!waiters.empty()) {
+			_resume_one(waiters);
+		}
+	}
+
+	template <typename... Args>
+	bool
+	_wait_and_emplace(suspender_i spdr, duration timeout, Args &&...args) {
+		if (!_wait_until(
+				_send_waiters,
+				[&]() -> bool {
+					return _emplace_raw(std::forward<Args>(args)...);
+				},
+				std::move(spdr),
+				timeout)) {
+			return false;
+		}
+		_notify(_recv_waiters);
+		return true;
+	}
+
+	friend _select_access;
+};
+
+template <typename T, typename V>
+inline spsc_chan<T> &operator<<(spsc_chan<T> &ch, V &&val) {
+	ch.emplace(std::forward<V>(val));
+	return ch;
+}
+
+template <typename T, typename R>
+inline spsc_chan<T> &operator<<(R &receiver, spsc_chan<T> &ch) {
+	receiver = ch.pop();
+	return ch;
+}
+
+} // namespace rua
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef _RUA_SYNC_WAITERS_HPP
+#define _RUA_SYNC_WAITERS_HPP
+
+#include "lockfree_list.hpp"
+
+#include "../chrono/tick.hpp"
+#include "../sched/suspender.hpp"
+
+namespace rua {
+
+inline bool _resume_one(lockfree_list<resumer_i> &waiters) {
+	auto waiter_opt = waiters.pop_back();
+	if (!waiter_opt) {
+		return false;
+	}
+	waiter_opt.value()->resume();
+	return true;
+}
+
+inline void _resume_all(lockfree_list<resumer_i> &waiters) {
+	auto li = waiters.pop_all();
+	while (li) {
+		li.pop_front()->resume();
+	}
+}
+
+// Waits until cond() returns true, cond() is also evaluated while the waiter
+// list is locked, so it may consume the value it is waiting for.
+template <typename Cond>
+inline bool _wait_until(
+	lockfree_list<resumer_i> &waiters,
+	Cond &&cond,
+	suspender_i spdr,
+	duration timeout) {
+	if (cond()) {
+		return true;
+	}
+	if (!timeout || !spdr) {
+		return false;
+	}
+
+	auto rsmr = spdr->get_resumer();
+
+	if (!waiters.emplace_front_if([&]() -> bool { return !cond(); }, rsmr)) {
+		return true;
+	}
+
+	for (;;) {
+		auto t = tick();
+		auto r = spdr->suspend(timeout);
+		auto is_done = cond();
+		if (!is_done) {
+			if (timeout != duration_max()) {
+				timeout -= tick() - t;
+			}
+			if (timeout > 0) {
+				if (!r) {
+					continue;
+				}
+				rsmr = spdr->get_resumer();
+				if (!waiters.emplace_front_if(
+						[&]() -> bool { return !cond(); }, rsmr)) {
+					return true;
+				}
+				continue;
+			}
+		}
+		// A resumer left in the list would swallow a later wakeup. If a
+		// notifier popped it after this waiter stopped suspending, the wakeup
+		// is passed on to the next waiter.
+		if (!waiters.erase(rsmr) && !r) {
+			_resume_one(waiters);
+		}
+		return is_done;
+	}
+	return false;
+}
+
+} // namespace rua
+
+#endif
@@ -23,6 +23,16 @@ using thread_suspender = darwin::thread_suspender;
 
 } // namespace rua
 
+#elif defined(__linux__)
+
+#include "suspender/futex.hpp"
+
+namespace rua {
+
+using thread_suspender = futex::thread_suspender;
+
+} // namespace rua
+
 #elif defined(RUA_UNIX) || RUA_HAS_INC(<pthread.h>) || defined(_PTHREAD_H)
 
 #include "suspender/posix.hpp"
@@ -72,9 +72,14 @@ public:
 	virtual bool suspend(duration timeout) {
 		assert(_rsmr);
 
+		if (timeout == duration_max()) {
+			return !dispatch_semaphore_wait(
+				_rsmr->native_handle(), DISPATCH_TIME_FOREVER);
+		}
+		// dispatch_semaphore_wait() takes a deadline, not an interval.
 		return !dispatch_semaphore_wait(
 			_rsmr->native_handle(),
-			timeout.nanoseconds<dispatch_time_t, DISPATCH_TIME_FOREVER>());
+			dispatch_time(DISPATCH_TIME_NOW, timeout.nanoseconds()));
 	}
 
 	virtual resumer_i get_resumer() {
@@ -0,0 +1,146 @@
+#ifndef _RUA_THREAD_SUSPENDER_FUTEX_HPP
+#define _RUA_THREAD_SUSPENDER_FUTEX_HPP
+
+#include "posix.hpp"
+
+#include "../../macros.hpp"
+#include "../../sched/suspender/abstract.hpp"
+#include "../../types/util.hpp"
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+
+namespace rua { namespace futex {
+
+// A single state word, resume() and reset() stay in user space unless the
+// owner thread is parked in the kernel.
+class thread_resumer : public resumer {
+public:
+	using native_handle_t = std::atomic<uint32_t> *;
+
+	enum : uint32_t { idle = 0, resumed, parked };
+
+	thread_resumer() : _state(idle) {}
+
+	virtual ~thread_resumer() = default;
+
+	native_handle_t native_handle() {
+		return &_state;
+	}
+
+	virtual void resume() {
+		if (_state.exchange(resumed) == parked) {
+			::syscall(
+				SYS_futex,
+				reinterpret_cast<uint32_t *>(&_state),
+				FUTEX_WAKE_PRIVATE,
+				1,
+				nullptr,
+				nullptr,
+				0);
+		}
+	}
+
+	void reset() {
+		_state.store(idle);
+	}
+
+private:
+	std::atomic<uint32_t> _state;
+};
+
+class thread_suspender : public suspender {
+public:
+	constexpr thread_suspender(duration yield_dur = 0) :
+		_yield_dur(yield_dur), _rsmr() {}
+
+	virtual ~thread_suspender() = default;
+
+	virtual void yield() {
+		if (_yield_dur > 1_us) {
+			sleep(_yield_dur);
+			return;
+		}
+		for (auto i = 0; i < 3; ++i) {
+			if (!sched_yield()) {
+				return;
+			}
+		}
+		::usleep(1);
+	}
+
+	virtual void sleep(duration timeout) {
+		auto dl = posix::_deadline(CLOCK_MONOTONIC, timeout);
+		while (::clock_nanosleep(
+				   CLOCK_MONOTONIC, TIMER_ABSTIME, &dl, nullptr) == EINTR)
+			;
+	}
+
+	virtual bool suspend(duration timeout) {
+		assert(_rsmr);
+
+		auto &st = *_rsmr->native_handle();
+
+		uint32_t old_st = thread_resumer::idle;
+		if (!st.compare_exchange_strong(old_st, thread_resumer::parked)) {
+			st.store(thread_resumer::idle);
+			return true;
+		}
+
+		auto is_forever = timeout == duration_max();
+		timespec dl;
+		if (!is_forever) {
+			dl = posix::_deadline(CLOCK_MONOTONIC, timeout);
+		}
+		for (;;) {
+			// FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline, so
+			// spurious wakeups and EINTR do not stretch the wait.
+			auto r = ::syscall(
+				SYS_futex,
+				reinterpret_cast<uint32_t *>(&st),
+				FUTEX_WAIT_BITSET_PRIVATE,
+				thread_resumer::parked,
+				is_forever ? nullptr : &dl,
+				nullptr,
+				FUTEX_BITSET_MATCH_ANY);
+			if (st.load() == thread_resumer::resumed) {
+				break;
+			}
+			if (r == -1 && errno == ETIMEDOUT) {
+				old_st = thread_resumer::parked;
+				if (st.compare_exchange_strong(old_st, thread_resumer::idle)) {
+					return false;
+				}
+				break;
+			}
+		}
+		st.store(thread_resumer::idle);
+		return true;
+	}
+
+	virtual resumer_i get_resumer() {
+		if (_rsmr) {
+			_rsmr->reset();
+		} else {
+			_rsmr = std::make_shared<thread_resumer>();
+		}
+		return _rsmr;
+	}
+
+private:
+	duration _yield_dur;
+	std::shared_ptr<thread_resumer> _rsmr;
+};
+
+}} // namespace rua::futex
+
+#endif
@@ -10,10 +10,18 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <cassert>
+#include <cerrno>
 #include <memory>
 
 namespace rua { namespace posix {
 
+inline timespec _deadline(clockid_t clk, duration timeout) {
+	timespec now;
+	clock_gettime(clk, &now);
+	return (duration(now) + timeout).c_timespec();
+}
+
 class thread_resumer : public resumer {
 public:
 	using native_handle_t = sem_t *;
@@ -71,18 +79,47 @@ public:
 	}
 
 	virtual void sleep(duration timeout) {
+#if defined(_POSIX_MONOTONIC_CLOCK) && _POSIX_MONOTONIC_CLOCK >= 0
+		auto dl = _deadline(CLOCK_MONOTONIC, timeout);
+		while (::clock_nanosleep(
+				   CLOCK_MONOTONIC, TIMER_ABSTIME, &dl, nullptr) == EINTR)
+			;
+#else
 		auto ts = timeout.c_timespec();
-		::nanosleep(&ts, nullptr);
+		while (::nanosleep(&ts, &ts) == -1 && errno == EINTR)
+			;
+#endif
 	}
 
 	virtual bool suspend(duration timeout) {
 		assert(_rsmr);
 
+		auto sem = _rsmr->native_handle();
+
 		if (timeout == duration_max()) {
-			return !sem_wait(_rsmr->native_handle());
+			while (sem_wait(sem)) {
+				if (errno != EINTR) {
+					return false;
+				}
+			}
+			return true;
 		}
-		auto ts = timeout.c_timespec();
-		return !sem_timedwait(_rsmr->native_handle(), &ts);
+
+		// Both take absolute deadlines, sem_clockwait() is immune to changes
+		// of the system clock.
+#if defined(__GLIBC__) &&                                                      \
+	(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+		auto dl = _deadline(CLOCK_MONOTONIC, timeout);
+		while (sem_clockwait(sem, CLOCK_MONOTONIC, &dl)) {
+#else
+		auto dl = _deadline(CLOCK_REALTIME, timeout);
+		while (sem_timedwait(sem, &dl)) {
+#endif
+			if (errno != EINTR) {
+				return false;
+			}
+		}
+		return true;
 	}
 
 	virtual resumer_i get_resumer() {
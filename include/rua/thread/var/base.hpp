@@ -3,18 +3,17 @@
 
 #include "../basic.hpp"
 
-#include "../../any.hpp"
 #include "../../any_word.hpp"
 #include "../../macros.hpp"
+#include "../../optional.hpp"
+#include "../../sync/concurrent_hash_map.hpp"
 #include "../../sync/lockfree_list.hpp"
 #include "../../types/util.hpp"
 
 #include <atomic>
 #include <cassert>
 #include <functional>
-#include <mutex>
 #include <type_traits>
-#include <unordered_map>
 #include <vector>
 
 namespace rua {
@@ -73,68 +72,57 @@ public:
 	}
 
 	void set(any_word value) {
-		auto &ctx = _ctx();
-		std::lock_guard<std::mutex> lg(ctx.mtx);
-
-		auto it = ctx.map.find(this_tid());
-		if (it == ctx.map.end()) {
-			ctx.map.emplace(
-				this_tid(),
-				std::make_pair(
-					static_cast<size_t>(0), std::vector<uintptr_t>()));
-			it = ctx.map.find(this_tid());
-		}
-		auto &li = it->second.second;
-		if (li.size() <= _ix) {
-			if (!value) {
-				return;
+		_ctx().map.compute(this_tid(), [this, value](optional<_entry_t> &e) {
+			if (!e) {
+				if (!value) {
+					return;
+				}
+				e.emplace(0, std::vector<uintptr_t>());
 			}
-			++it->second.first;
-			li.resize(_ix + 1);
-		} else if (!li[_ix]) {
-			if (!value) {
-				return;
+			auto &li = e->second;
+			if (li.size() <= _ix) {
+				if (!value) {
+					return;
+				}
+				li.resize(_ix + 1);
 			}
-			++it->second.first;
-		} else if (li[_ix] && !value) {
-			--it->second.first;
-		}
-		li[_ix] = value;
+			if (!li[_ix] && value) {
+				++e->first;
+			} else if (li[_ix] && !value) {
+				--e->first;
+			}
+			li[_ix] = value;
+			if (!e->first) {
+				e.reset();
+			}
+		});
 	}
 
 	any_word get() const {
-		auto &ctx = _ctx();
-		std::lock_guard<std::mutex> lg(ctx.mtx);
-
-		auto it = ctx.map.find(this_tid());
-		if (it == ctx.map.end()) {
-			return 0;
-		}
-		auto &li = it->second.second;
-		if (li.size() <= _ix) {
-			return 0;
-		}
-		return li[_ix];
+		uintptr_t r = 0;
+		_ctx().map.visit(this_tid(), [this, &r](const _entry_t &e) {
+			if (e.second.size() > _ix) {
+				r = e.second[_ix];
+			}
+		});
+		return r;
 	}
 
 	void reset() {
-		auto &ctx = _ctx();
-		std::lock_guard<std::mutex> lg(ctx.mtx);
-
-		auto it = ctx.map.find(this_tid());
-		if (it == ctx.map.end()) {
-			return;
-		}
-		auto &li = it->second.second;
-		if (li.size() <= _ix) {
-			return;
-		}
-		if (!li[_ix]) {
-			return;
-		}
-		_dtor(li[_ix]);
-		if (--it->second.first) {
-			ctx.map.erase(it);
+		uintptr_t old_val = 0;
+		_ctx().map.compute(this_tid(), [this, &old_val](optional<_entry_t> &e) {
+			if (!e || e->second.size() <= _ix || !e->second[_ix]) {
+				return;
+			}
+			old_val = e->second[_ix];
+			e->second[_ix] = 0;
+			if (!--e->first) {
+				e.reset();
+			}
+		});
+		// Outside of the map lock, the destructor may use thread vars again.
+		if (old_val) {
+			_dtor(old_val);
 		}
 	}
 
@@ -142,13 +130,12 @@ private:
 	size_t _ix;
 	void (*_dtor)(any_word);
 
-	using _map_t =
-		std::unordered_map<tid_t, std::pair<size_t, std::vector<uintptr_t>>>;
+	// Count of non-empty words and the words.
+	using _entry_t = std::pair<size_t, std::vector<uintptr_t>>;
 
 	struct _ctx_t {
 		_thread_var_indexer ixer;
-		std::mutex mtx;
-		_map_t map;
+		concurrent_hash_map<tid_t, _entry_t> map;
 	};
 
 	static _ctx_t &_ctx() {
@@ -166,7 +153,9 @@ public:
 	basic_thread_var() : _ix(_ixer().alloc()) {}
 
 	~basic_thread_var() {
-		_ixer().dealloc(_ix);
+		if (is_storable()) {
+			_ixer().dealloc(_ix);
+		}
 	}
 
 	basic_thread_var(basic_thread_var &&src) : _ix(src._ix) {
@@ -182,44 +171,40 @@ public:
 	}
 
 	bool has_value() const {
-		auto &wv = using_word_var();
-		auto w = wv.get();
-		if (!w) {
-			return false;
-		}
-		auto &li = w.template as<std::vector<any>>();
-		if (li.size() <= _ix) {
-			return false;
-		}
-		return li[_ix].template type_is<T>();
+		auto slots = _slots();
+		return slots && slots->size > _ix && slots->begin()[_ix];
 	}
 
 	template <typename... Args>
 	T &emplace(Args &&...args) {
 		RUA_SPASSERT((std::is_constructible<T, Args...>::value));
 
-		auto &li = _li();
-		if (li.size() <= _ix) {
-			li.resize(_ix + 1);
+		auto &val = _slots_of(_ix)->begin()[_ix];
+		auto old_val = val;
+		val = new T(std::forward<Args>(args)...);
+		if (old_val) {
+			delete old_val;
 		}
-		return li[_ix].template emplace<T>(std::forward<Args>(args)...);
+		return *val;
 	}
 
 	T &value() const {
-		return _li()[_ix].template as<T>();
+		assert(has_value());
+		return *_slots()->begin()[_ix];
 	}
 
 	void reset() {
-		auto &wv = using_word_var();
-		auto w = wv.get();
-		if (!w) {
+		auto slots = _slots();
+		if (!slots || slots->size <= _ix) {
 			return;
 		}
-		auto &li = w.template as<std::vector<any>>();
-		if (li.size() <= _ix) {
+		auto &val = slots->begin()[_ix];
+		if (!val) {
 			return;
 		}
-		li[_ix].reset();
+		auto old_val = val;
+		val = nullptr;
+		delete old_val;
 	}
 
 	class word_var_wrapper {
@@ -285,13 +270,46 @@ public:
 private:
 	size_t _ix;
 
+	// The values of a thread, indexed by variable. The pointers follow the
+	// header in the same block, so a lookup is one load plus an index, and the
+	// values never move when the block grows.
+	struct _slots_t {
+		size_t size;
+
+		T **begin() {
+			return reinterpret_cast<T **>(this + 1);
+		}
+
+		static _slots_t *make(size_t size) {
+			auto slots = reinterpret_cast<_slots_t *>(
+				::operator new(sizeof(_slots_t) + size * sizeof(T *)));
+			slots->size = size;
+			for (size_t i = 0; i < size; ++i) {
+				slots->begin()[i] = nullptr;
+			}
+			return slots;
+		}
+
+		static void destroy(_slots_t *slots) {
+			for (size_t i = 0; i < slots->size; ++i) {
+				auto val = slots->begin()[i];
+				if (val) {
+					slots->begin()[i] = nullptr;
+					delete val;
+				}
+			}
+			::operator delete(slots);
+		}
+	};
+
 	template <typename TWV>
 	static TWV &_word_var() {
 		static TWV inst([](any_word val) {
 			if (!val) {
 				return;
 			}
-			val.destruct<std::vector<any>>();
+			_slots_cache() = nullptr;
+			_slots_t::destroy(val.as<_slots_t *>());
 		});
 		return inst;
 	}
@@ -301,14 +319,41 @@ private:
 		return inst;
 	}
 
-	static std::vector<any> &_li() {
-		auto &wv = using_word_var();
-		auto w = wv.get();
-		if (!w) {
-			w = std::vector<any>();
-			wv.set(w);
+	// Mirrors the word of the current thread, the word var still owns the
+	// block and destroys it when the thread exits.
+	static _slots_t *&_slots_cache() {
+		static thread_local _slots_t *slots = nullptr;
+		return slots;
+	}
+
+	static _slots_t *_slots() {
+		auto slots = _slots_cache();
+		if (slots) {
+			return slots;
+		}
+		return using_word_var().get().template as<_slots_t *>();
+	}
+
+	// Grows the block of the current thread to cover ix.
+	static _slots_t *_slots_of(size_t ix) {
+		auto slots = _slots();
+		if (slots && slots->size > ix) {
+			return slots;
+		}
+		auto new_size = slots ? slots->size * 2 : 8;
+		if (new_size <= ix) {
+			new_size = ix + 1;
+		}
+		auto new_slots = _slots_t::make(new_size);
+		if (slots) {
+			for (size_t i = 0; i < slots->size; ++i) {
+				new_slots->begin()[i] = slots->begin()[i];
+			}
+			::operator delete(slots);
 		}
-		return w.template as<std::vector<any>>();
+		using_word_var().set(new_slots);
+		_slots_cache() = new_slots;
+		return new_slots;
 	}
 };
 
@@ -0,0 +1,120 @@
+#include <rua/coro.hpp>
+
+#ifdef RUA_COROUTINE_SUPPORTED
+
+#include <rua/thread.hpp>
+
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <string>
+
+static rua::coro_task<int> coro_add(int a, int b) {
+	co_await rua::coro_sleep(10);
+	co_return a + b;
+}
+
+static rua::coro_task<>
+coro_first(rua::chan<int> &ch, rua::mutex &mtx, std::string &r) {
+	co_await rua::coro_lock(mtx);
+	r += "1";
+	co_await rua::coro_sleep(100);
+	r += "1";
+	mtx.unlock();
+
+	r += std::to_string(co_await rua::coro_pop(ch));
+}
+
+static rua::coro_task<>
+coro_second(rua::chan<int> &ch, rua::mutex &mtx, std::string &r) {
+	r += "2";
+	co_await rua::coro_lock(mtx);
+	r += "2";
+	mtx.unlock();
+
+	auto n = co_await rua::coro_await(
+		rua::cpu_pool(), [](int a) { return a * 2; }, 3);
+	ch.emplace(co_await coro_add(n, 1));
+}
+
+TEST_CASE("coro_executor run") {
+	rua::coro_executor exr;
+	rua::chan<int> ch;
+	rua::mutex mtx;
+	std::string r;
+
+	exr.execute(coro_first(ch, mtx, r));
+	exr.execute(coro_second(ch, mtx, r));
+
+	rua::thread([&]() {
+		rua::sleep(50);
+		REQUIRE(!mtx.try_lock());
+	});
+
+	exr.run();
+
+	REQUIRE(r == "12127");
+}
+
+static rua::coro_task<> coro_await_last(std::atomic<int> &c) {
+	co_await rua::coro_await(rua::cpu_pool(), [&c]() { ++c; });
+}
+
+TEST_CASE("coro_executor destroyed right after a pool resume") {
+	std::atomic<int> c(0);
+	for (int i = 0; i < 1000; ++i) {
+		rua::coro_executor exr;
+		exr.execute(coro_await_last(c));
+		exr.run();
+	}
+	REQUIRE(c == 1000);
+}
+
+class mem_stream : public rua::reader, public rua::writer {
+public:
+	rua::tid_t last_tid = 0;
+
+	virtual ptrdiff_t read(rua::bytes_ref p) {
+		last_tid = rua::this_tid();
+		auto sz = p.size() < _data.size() ? p.size() : _data.size();
+		p.copy_from(rua::as_bytes(_data.data(), sz));
+		_data.erase(0, sz);
+		return static_cast<ptrdiff_t>(sz);
+	}
+
+	virtual ptrdiff_t write(rua::bytes_view p) {
+		last_tid = rua::this_tid();
+		_data.append(reinterpret_cast<const char *>(p.data()), p.size());
+		return static_cast<ptrdiff_t>(p.size());
+	}
+
+private:
+	std::string _data;
+};
+
+static rua::coro_task<std::string> coro_echo(mem_stream &ms) {
+	std::string src("hello");
+	auto wsz = co_await rua::coro_write(ms, rua::as_bytes(src));
+	REQUIRE(wsz == 5);
+
+	std::string buf(5, 0);
+	auto rsz = co_await rua::coro_read(ms, rua::as_writable_bytes(buf));
+	REQUIRE(rsz == 5);
+	co_return buf;
+}
+
+static rua::coro_task<> coro_check_echo(mem_stream &ms) {
+	auto r = co_await coro_echo(ms);
+	REQUIRE(r == "hello");
+}
+
+TEST_CASE("coro_read and coro_write run off the executor thread") {
+	mem_stream ms;
+	rua::coro_executor exr;
+	exr.execute(coro_check_echo(ms));
+	exr.run();
+	REQUIRE(ms.last_tid);
+	REQUIRE(ms.last_tid != rua::this_tid());
+}
+
+#endif
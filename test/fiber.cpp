@@ -3,6 +3,10 @@
 
 #include <doctest/doctest.h>
 
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <memory>
 #include <string>
 
 TEST_CASE("fiber_executor run") {
@@ -136,6 +140,30 @@ TEST_CASE("co") {
 	REQUIRE(r == "123321");
 }
 
+TEST_CASE("await on fiber") {
+	static std::string r;
+
+	rua::co([]() {
+		rua::co([]() {
+			auto sum = rua::await(
+				[](int a, int b) -> int {
+					rua::sleep(100);
+					return a + b;
+				},
+				1,
+				2);
+			REQUIRE(sum == 3);
+			r += "2";
+		});
+		rua::co([]() {
+			rua::await([]() { rua::sleep(50); });
+			r += "1";
+		});
+	});
+
+	REQUIRE(r == "12");
+}
+
 TEST_CASE("use chan on fiber") {
 	rua::co([]() {
 		static rua::chan<std::string> ch;
@@ -148,3 +176,291 @@ TEST_CASE("use chan on fiber") {
 		REQUIRE(ch.pop() == "ok");
 	});
 }
+
+TEST_CASE("select chans on fiber") {
+	rua::co([]() {
+		static rua::chan<int> ch1, ch2;
+
+		rua::co([]() { ch1 << 1; });
+
+		REQUIRE(rua::select(ch1, ch2) == 0);
+		REQUIRE(ch1.pop() == 1);
+
+		rua::thread([]() mutable {
+			rua::sleep(100);
+			ch2 << 2;
+		});
+
+		REQUIRE(rua::select(ch1, ch2) == 1);
+		REQUIRE(ch2.pop() == 2);
+	});
+}
+
+TEST_CASE("condition_variable on fiber") {
+	static rua::fiber_executor exr;
+	static rua::mutex mtx;
+	static rua::condition_variable cv;
+	static std::string r;
+
+	exr.execute([]() {
+		mtx.lock();
+		REQUIRE(cv.wait_until(mtx, []() -> bool { return r == "1"; }));
+		r += "2";
+		mtx.unlock();
+	});
+	exr.execute([]() {
+		mtx.lock();
+		REQUIRE(!cv.wait(mtx, 50));
+		r += "1";
+		mtx.unlock();
+		cv.notify_all();
+	});
+	exr.run();
+
+	REQUIRE(r == "12");
+}
+
+TEST_CASE("mutex fifo handoff on fiber") {
+	static rua::fiber_executor exr;
+	static auto &spdr = exr.get_suspender();
+	static rua::mutex mtx(rua::mutex_handoff::fifo);
+	static std::string r;
+
+	exr.execute([]() {
+		mtx.lock();
+		spdr.sleep(100);
+		mtx.unlock();
+
+		// The lock was handed to the oldest waiter, so it cannot be barged.
+		REQUIRE(!mtx.try_lock());
+		mtx.lock();
+		r += "4";
+		mtx.unlock();
+	});
+	for (int i = 1; i <= 3; ++i) {
+		exr.execute([i]() {
+			mtx.lock();
+			r += std::to_string(i);
+			spdr.yield();
+			mtx.unlock();
+		});
+	}
+	exr.run();
+
+	REQUIRE(r == "1234");
+}
+
+TEST_CASE("fiber_var") {
+	static rua::fiber_executor exr;
+	static auto &spdr = exr.get_suspender();
+	static rua::fiber_var<std::string> fv;
+	static std::string r;
+
+	exr.execute([]() {
+		fv.emplace("1");
+		spdr.sleep(200);
+		r += fv.value();
+	});
+	exr.execute([]() {
+		REQUIRE(!fv.has_value());
+		fv.emplace("2");
+		spdr.sleep(100);
+		r += fv.value();
+	});
+
+	exr.run();
+
+	REQUIRE(r == "21");
+	REQUIRE(!fv.has_value());
+}
+
+TEST_CASE("fiber priority") {
+	static rua::fiber_executor exr;
+	static std::string r;
+
+	exr.execute([]() { r += "1"; }, 0, rua::fiber_priority::low);
+	exr.execute([]() { r += "2"; });
+	exr.execute([]() { r += "3"; }, 0, rua::fiber_priority::realtime);
+	exr.execute([]() { r += "4"; }, 0, rua::fiber_priority::high);
+
+	exr.step();
+
+	REQUIRE(r == "3421");
+}
+
+TEST_CASE("fiber_executor edf") {
+	static rua::fiber_executor exr(0x100000, rua::fiber_sched_mode::edf);
+	static std::string r;
+
+	exr.execute(
+		[]() {
+			r += "1";
+			rua::this_fiber().stop();
+		},
+		3000);
+	exr.execute(
+		[]() {
+			r += "2";
+			rua::this_fiber().stop();
+		},
+		1000);
+	exr.execute(
+		[]() {
+			r += "3";
+			rua::this_fiber().stop();
+		},
+		2000);
+
+	exr.step();
+
+	REQUIRE(r == "231");
+}
+
+TEST_CASE("fiber_group") {
+	rua::co([]() {
+		rua::fiber_group grp;
+
+		auto f1 = grp.spawn([]() -> std::string {
+			rua::sleep(200);
+			return "1";
+		});
+		auto f2 = grp.spawn([]() -> std::string {
+			rua::sleep(100);
+			return "2";
+		});
+		auto f3 = grp.spawn([]() {
+			rua::sleep(300);
+			REQUIRE(!rua::this_fiber());
+		});
+
+		REQUIRE(grp.join_any());
+		REQUIRE(f2.is_ready());
+		REQUIRE(!f1.is_ready());
+
+		REQUIRE(!grp.join_all(50));
+
+		REQUIRE(f1.get() == "1");
+		grp.cancel();
+
+		auto f4 = grp.spawn([]() -> int { return 4; });
+
+		REQUIRE(grp.join_all());
+		REQUIRE(grp.size() == 4);
+		REQUIRE(!grp.pending());
+		REQUIRE(f2.get() == "2");
+		REQUIRE(f3.try_get());
+		REQUIRE(f4.is_ready());
+		REQUIRE(!f4.try_get());
+	});
+}
+
+TEST_CASE("fiber preemption") {
+	static rua::fiber_executor exr;
+	static bool ran = false;
+
+	exr.enable_preemption(10);
+
+	exr.execute([]() {
+		auto end_ti = rua::tick() + 1000;
+		while (!ran && rua::tick() < end_ti) {
+			rua::preempt_point();
+		}
+		REQUIRE(ran);
+	});
+	exr.execute([]() { ran = true; });
+
+	exr.run();
+
+	REQUIRE(ran);
+}
+
+#ifdef __linux__
+
+// Counts the signals that interrupt a 100ms sleep.
+static int interrupted_sleep() {
+	int c = 0;
+	timespec ts;
+	ts.tv_sec = 0;
+	ts.tv_nsec = 100000000;
+	while (::clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR) {
+		++c;
+	}
+	return c;
+}
+
+TEST_CASE("posix preempt_timer signals once per slice") {
+	rua::posix::preempt_timer pt(10);
+
+	pt.start();
+	REQUIRE(interrupted_sleep() == 1);
+	REQUIRE(pt.is_expired());
+
+	// Consuming the expiry rearms the timer.
+	pt.reset();
+	REQUIRE(!pt.is_expired());
+	REQUIRE(interrupted_sleep() == 1);
+	REQUIRE(pt.is_expired());
+
+	pt.stop();
+	pt.reset();
+	REQUIRE(interrupted_sleep() == 0);
+	REQUIRE(!pt.is_expired());
+}
+
+#endif
+
+TEST_CASE("fiber_executor stats") {
+	static rua::fiber_executor exr;
+	static auto &spdr = exr.get_suspender();
+
+	exr.enable_stats_timing();
+
+	exr.execute([]() {
+		spdr.sleep(50);
+		spdr.yield();
+	});
+	exr.execute([]() { spdr.yield(); });
+
+	REQUIRE(exr.stats().queued.load() == 2);
+
+	exr.run();
+
+	auto &st = exr.stats();
+	REQUIRE(st.queued.load() == 0);
+	REQUIRE(st.sleeping.load() == 0);
+	REQUIRE(st.switches.load() >= 5);
+	REQUIRE(st.copied_bytes.load() > 0);
+	REQUIRE(st.run_queue_wait.count() >= 5);
+	REQUIRE(st.copied_bytes_per_switch.count() == st.switches.load());
+	REQUIRE(
+		st.run_queue_wait.percentile(50) <= st.run_queue_wait.percentile(99));
+}
+
+class plain_suspender : public rua::suspender {};
+
+TEST_CASE("suspender_guard on a fiber stack") {
+	static rua::fiber_executor exr;
+	static auto &spdr = exr.get_suspender();
+	static bool is_checked = false;
+
+	// The guard stays alive while its fiber is switched out, and the third
+	// fiber reuses the stack it was built on.
+	exr.execute([]() {
+		rua::suspender_guard sg(std::make_shared<plain_suspender>());
+		spdr.sleep(100);
+	});
+	exr.execute([]() { spdr.sleep(50); });
+	exr.execute([]() {
+		char buf[4096];
+		std::memset(buf, 0xFF, sizeof(buf));
+		auto cur = rua::this_suspender();
+		REQUIRE(cur);
+		REQUIRE(cur->is_own_stack());
+		is_checked = buf[0] != 0;
+	});
+
+	exr.run();
+
+	REQUIRE(is_checked);
+	REQUIRE(rua::this_suspender()->is_own_stack());
+}
@@ -1,8 +1,18 @@
 #include <rua/thread.hpp>
 
+#ifdef __linux__
+#include <rua/thread/suspender/posix.hpp>
+#endif
+
 #include <doctest/doctest.h>
 
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 TEST_CASE("thread") {
 	static std::string r;
@@ -25,3 +35,689 @@ TEST_CASE("use chan on thread") {
 
 	REQUIRE(ch.pop() == "ok");
 }
+
+// Runs on_suspend() the first time it suspends, then times out.
+class timeout_suspender : public rua::suspender {
+public:
+	explicit timeout_suspender(std::function<void()> on_suspend) :
+		_on_suspend(std::move(on_suspend)),
+		_rsmr(std::make_shared<rua::resumer>()) {}
+
+	virtual ~timeout_suspender() = default;
+
+	virtual bool suspend(rua::duration timeout) {
+		if (_on_suspend) {
+			auto on_suspend = std::move(_on_suspend);
+			_on_suspend = nullptr;
+			on_suspend();
+			return false;
+		}
+		rua::sleep(timeout);
+		return false;
+	}
+
+	virtual rua::resumer_i get_resumer() {
+		return _rsmr;
+	}
+
+private:
+	std::function<void()> _on_suspend;
+	std::shared_ptr<rua::resumer> _rsmr;
+};
+
+TEST_CASE("timed chan waiters do not lose wakeups") {
+	static rua::chan<int> ch;
+	static rua::optional<int> a_val;
+
+	auto a = rua::thread([]() mutable { a_val = ch.try_pop(2000); });
+	rua::sleep(100);
+
+	// The value resumes the older waiter, but the newer one takes it as it
+	// times out and must not leave its resumer behind.
+	auto b_val = ch.try_pop(
+		std::make_shared<timeout_suspender>([]() { ch.emplace(1); }), 10);
+	rua::sleep(100);
+	auto t = rua::tick();
+	ch.emplace(2);
+
+	// A lost wakeup leaves the older waiter asleep until it times out.
+	a.wait_for_exit();
+	REQUIRE(rua::tick() - t < 1000);
+	REQUIRE(a_val);
+	REQUIRE(a_val.value() == (b_val ? 2 : 1));
+	REQUIRE(!b_val || b_val.value() == 1);
+}
+
+TEST_CASE("use bounded_chan on thread") {
+	static rua::bounded_chan<int> ch(2);
+
+	REQUIRE(ch.try_emplace(1));
+	REQUIRE(ch.try_emplace(2));
+	REQUIRE(!ch.try_emplace(3));
+	REQUIRE(ch.pop() == 1);
+	REQUIRE(ch.pop() == 2);
+
+	rua::thread([]() mutable {
+		for (int i = 1; i <= 1000; ++i) {
+			ch.push(i);
+		}
+	});
+
+	int sum = 0;
+	for (int i = 1; i <= 1000; ++i) {
+		sum += ch.pop();
+	}
+	REQUIRE(sum == 500500);
+	REQUIRE(!ch.try_pop());
+}
+
+TEST_CASE("use spsc_chan on thread") {
+	static rua::spsc_chan<std::string> ch(4);
+
+	REQUIRE(ch.capacity() == 4);
+	for (int i = 0; i < 4; ++i) {
+		REQUIRE(ch.try_emplace(std::to_string(i)));
+	}
+	REQUIRE(!ch.try_emplace("4"));
+	REQUIRE(ch.pop() == "0");
+	REQUIRE(ch.try_pop(10).value() == "1");
+	REQUIRE(ch.pop() == "2");
+	REQUIRE(ch.pop() == "3");
+	REQUIRE(!ch.try_pop(10));
+
+	rua::thread([]() mutable {
+		for (int i = 1; i <= 100000; ++i) {
+			ch.push(std::to_string(i));
+		}
+	});
+
+	long long sum = 0;
+	for (int i = 1; i <= 100000; ++i) {
+		sum += std::stoi(ch.pop());
+	}
+	REQUIRE(sum == 5000050000LL);
+	REQUIRE(ch.empty());
+}
+
+TEST_CASE("use lockfree_queue on threads") {
+	static rua::lockfree_queue<int> que;
+	static rua::chan<bool> dones;
+
+	for (int t = 0; t < 4; ++t) {
+		rua::thread([]() mutable {
+			for (int i = 1; i <= 1000; ++i) {
+				que.emplace(i);
+			}
+			dones << true;
+		});
+	}
+	for (int t = 0; t < 4; ++t) {
+		dones.pop();
+	}
+
+	int sum = 0;
+	while (auto val_opt = que.pop()) {
+		sum += val_opt.value();
+	}
+	REQUIRE(sum == 500500 * 4);
+	REQUIRE(que.empty());
+}
+
+struct queue_drainer {
+	static rua::lockfree_queue<int> que;
+	static std::atomic<int> sum;
+
+	~queue_drainer() {
+		while (auto val_opt = que.pop()) {
+			sum += val_opt.value();
+		}
+	}
+};
+
+rua::lockfree_queue<int> queue_drainer::que;
+std::atomic<int> queue_drainer::sum(0);
+
+TEST_CASE("pop lockfree_queue in thread_var destructors") {
+	static rua::thread_var<queue_drainer> tv;
+	static rua::chan<bool> dones;
+
+	// The drainers run after the hazard records of their threads are
+	// released.
+	for (int t = 0; t < 4; ++t) {
+		rua::thread([]() mutable {
+			for (int i = 1; i <= 1000; ++i) {
+				queue_drainer::que.emplace(i);
+			}
+			tv.emplace();
+			dones << true;
+		});
+	}
+	for (int t = 0; t < 4; ++t) {
+		dones.pop();
+	}
+
+	for (int i = 0; i < 100 && queue_drainer::sum.load() < 500500 * 4; ++i) {
+		rua::sleep(10);
+	}
+	REQUIRE(queue_drainer::sum.load() == 500500 * 4);
+	REQUIRE(queue_drainer::que.empty());
+}
+
+TEST_CASE("select chans on thread") {
+	static rua::chan<int> ch1;
+	static rua::chan<std::string> ch2;
+
+	REQUIRE(!rua::try_select(10, ch1, ch2));
+
+	rua::thread([]() mutable {
+		rua::sleep(100);
+		ch2 << "ok";
+	});
+
+	REQUIRE(rua::select(ch1, ch2) == 1);
+	REQUIRE(ch2.pop() == "ok");
+	REQUIRE(ch1.empty());
+}
+
+TEST_CASE("chan batch on thread") {
+	static rua::chan<int> ch;
+
+	rua::thread([]() mutable {
+		rua::sleep(100);
+		int vals[] = {1, 2, 3, 4, 5};
+		ch.emplace_many(std::begin(vals), std::end(vals));
+	});
+
+	auto vals = ch.pop_many(3);
+	REQUIRE(vals.size() >= 1);
+	REQUIRE(vals.front() == 1);
+	while (vals.size() < 5) {
+		auto more = ch.pop_many(3);
+		vals.insert(vals.end(), more.begin(), more.end());
+	}
+	REQUIRE(vals.back() == 5);
+	REQUIRE(ch.pop_many(3, 10).empty());
+}
+
+TEST_CASE("mutex handoff modes on threads") {
+	static rua::mutex fifo_mtx = {};
+	static rua::mutex barging_mtx(rua::mutex_handoff::barging);
+	static int fifo_c = 0, barging_c = 0;
+	static rua::chan<bool> dones;
+
+	for (int t = 0; t < 4; ++t) {
+		rua::thread([]() mutable {
+			for (int i = 0; i < 1000; ++i) {
+				fifo_mtx.lock();
+				++fifo_c;
+				fifo_mtx.unlock();
+
+				barging_mtx.lock();
+				++barging_c;
+				barging_mtx.unlock();
+			}
+			dones << true;
+		});
+	}
+	for (int t = 0; t < 4; ++t) {
+		dones.pop();
+	}
+
+	REQUIRE(fifo_c == 4000);
+	REQUIRE(barging_c == 4000);
+	REQUIRE(
+		fifo_mtx.stats().contentions.load() >=
+		fifo_mtx.stats().spin_acquisitions.load());
+}
+
+TEST_CASE("shared_mutex on threads") {
+	static rua::shared_mutex smtx;
+	static int val = 0;
+	static std::atomic<bool> is_torn(false);
+	static rua::chan<bool> dones;
+
+	for (int t = 0; t < 4; ++t) {
+		rua::thread([]() mutable {
+			for (int i = 0; i < 1000; ++i) {
+				rua::shared_lock_guard<rua::shared_mutex> lg(smtx);
+				auto v = val;
+				if (v % 2) {
+					is_torn = true;
+				}
+			}
+			dones << true;
+		});
+	}
+	rua::thread([]() mutable {
+		for (int i = 0; i < 1000; ++i) {
+			rua::lock_guard<rua::shared_mutex> lg(smtx);
+			++val;
+			++val;
+		}
+		dones << true;
+	});
+	for (int t = 0; t < 5; ++t) {
+		dones.pop();
+	}
+
+	REQUIRE(val == 2000);
+	REQUIRE(!is_torn);
+
+	REQUIRE(smtx.try_lock_shared());
+	REQUIRE(!smtx.try_lock(10));
+	smtx.unlock_shared();
+	REQUIRE(smtx.try_lock());
+	REQUIRE(!smtx.try_lock_shared(10));
+	smtx.unlock();
+}
+
+TEST_CASE("semaphore, latch and barrier on threads") {
+	static rua::counting_semaphore sem(0);
+	static rua::latch lch(3);
+	static std::atomic<int> phase_c(0);
+	static rua::barrier bar(3, []() { ++phase_c; });
+
+	REQUIRE(!sem.try_acquire(10));
+
+	for (int t = 0; t < 3; ++t) {
+		rua::thread([]() mutable {
+			for (int i = 0; i < 10; ++i) {
+				bar.arrive_and_wait();
+			}
+			sem.release();
+			lch.count_down();
+		});
+	}
+
+	for (int t = 0; t < 3; ++t) {
+		sem.acquire();
+	}
+	REQUIRE(lch.wait(1000));
+	REQUIRE(phase_c == 10);
+	REQUIRE(sem.count() == 0);
+}
+
+TEST_CASE("thread_suspender resume and timeout") {
+	rua::thread_suspender spdr;
+
+	auto rsmr = spdr.get_resumer();
+	rsmr->resume();
+	REQUIRE(spdr.suspend(rua::duration_max()));
+
+	rsmr = spdr.get_resumer();
+	auto t = rua::tick();
+	REQUIRE(!spdr.suspend(50));
+	REQUIRE(rua::tick() - t >= 40);
+
+	rsmr = spdr.get_resumer();
+	rua::thread([rsmr]() mutable {
+		rua::sleep(50);
+		rsmr->resume();
+	});
+	REQUIRE(spdr.suspend(rua::duration_max()));
+}
+
+#ifdef CLOCK_THREAD_CPUTIME_ID
+
+// Other threads of the process may be busy, so only this thread is measured.
+static int64_t thread_cpu_ms() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+TEST_CASE("idle timed pop does not burn cpu") {
+	static rua::chan<int> ch;
+
+	auto cpu = thread_cpu_ms();
+	auto t = rua::tick();
+	REQUIRE(!ch.try_pop(300));
+	auto elapsed = rua::tick() - t;
+	auto cpu_ms = thread_cpu_ms() - cpu;
+
+	REQUIRE(elapsed >= 290);
+	REQUIRE(cpu_ms < 50);
+}
+
+#endif
+
+#ifdef __linux__
+
+// Linux defaults to the futex suspender, this covers the sem_clockwait()
+// deadlines of the POSIX one.
+TEST_CASE("posix thread_suspender deadlines") {
+	rua::thread([]() mutable {
+		rua::suspender_guard sg(
+			std::make_shared<rua::posix::thread_suspender>());
+		static rua::chan<int> ch;
+
+		auto t = rua::tick();
+		REQUIRE(!ch.try_pop(200));
+		REQUIRE(rua::tick() - t >= 190);
+
+		t = rua::tick();
+		rua::sleep(100);
+		REQUIRE(rua::tick() - t >= 95);
+
+		rua::thread([]() mutable {
+			rua::sleep(50);
+			ch << 1;
+		});
+		REQUIRE(ch.try_pop(1000).value() == 1);
+	}).wait_for_exit();
+}
+
+#endif
+
+TEST_CASE("use lockfree_stack on threads") {
+	static rua::lockfree_stack<int> stk;
+	static std::atomic<int> popped_sum(0);
+	static rua::chan<bool> dones;
+
+	for (int t = 0; t < 4; ++t) {
+		rua::thread([]() mutable {
+			for (int i = 1; i <= 1000; ++i) {
+				stk.emplace(i);
+				if (i % 2) {
+					popped_sum += stk.pop().value();
+				}
+			}
+			dones << true;
+		});
+	}
+	for (int t = 0; t < 4; ++t) {
+		dones.pop();
+	}
+
+	while (auto val_opt = stk.pop()) {
+		popped_sum += val_opt.value();
+	}
+	REQUIRE(popped_sum == 500500 * 4);
+	rua::hazard_reclaim();
+}
+
+TEST_CASE("concurrent_hash_map on threads") {
+	static rua::concurrent_hash_map<int, int> map;
+	static rua::chan<bool> dones;
+
+	for (int t = 0; t < 4; ++t) {
+		rua::thread([t]() mutable {
+			for (int i = 0; i < 250; ++i) {
+				map.emplace(t * 250 + i, i);
+				map.compute(-1, [](rua::optional<int> &c) {
+					c.emplace(c ? c.value() + 1 : 1);
+				});
+				REQUIRE(map.find(t * 250 + i).value() == i);
+			}
+			dones << true;
+		});
+	}
+	for (int t = 0; t < 4; ++t) {
+		dones.pop();
+	}
+
+	REQUIRE(map.size() == 1001);
+	REQUIRE(map.find(-1).value() == 1000);
+	REQUIRE(!map.emplace(0, 1));
+	REQUIRE(map.erase(0));
+	REQUIRE(!map.contains(0));
+
+	for (int i = 1; i < 1000; ++i) {
+		REQUIRE(map.erase(i));
+	}
+	REQUIRE(map.size() == 1);
+	REQUIRE(map.find(-1).value() == 1000);
+}
+
+TEST_CASE("spare_thread_word_var") {
+	static int dtor_c = 0;
+	static rua::spare_thread_word_var wv([](rua::any_word) { ++dtor_c; });
+
+	REQUIRE(!wv.get());
+	wv.set(123);
+	REQUIRE(wv.get().value() == 123);
+
+	rua::thread([]() mutable {
+		REQUIRE(!wv.get());
+		wv.set(456);
+		REQUIRE(wv.get().value() == 456);
+		wv.reset();
+		REQUIRE(!wv.get());
+	}).wait_for_exit();
+
+	REQUIRE(dtor_c == 1);
+	REQUIRE(wv.get().value() == 123);
+	wv.reset();
+	REQUIRE(!wv.get());
+}
+
+TEST_CASE("thread_var slots grow without moving values") {
+	static std::vector<rua::thread_var<std::string>> vars(20);
+
+	auto &first = vars[0].emplace("0");
+	for (size_t i = 1; i < vars.size(); ++i) {
+		vars[i].emplace(std::to_string(i));
+	}
+	REQUIRE(&vars[0].value() == &first);
+	REQUIRE(vars[19].value() == "19");
+
+	rua::thread([]() mutable {
+		REQUIRE(!vars[0].has_value());
+		vars[5].emplace("x");
+		REQUIRE(vars[5].value() == "x");
+		REQUIRE(!vars[19].has_value());
+	}).wait_for_exit();
+
+	REQUIRE(vars[5].value() == "5");
+	vars[5].reset();
+	REQUIRE(!vars[5].has_value());
+	REQUIRE(vars[6].value() == "6");
+}
+
+class test_suspender : public rua::suspender {
+public:
+	explicit test_suspender(bool *is_destroyed = nullptr) :
+		_is_destroyed(is_destroyed) {}
+
+	virtual ~test_suspender() {
+		if (_is_destroyed) {
+			*_is_destroyed = true;
+		}
+	}
+
+private:
+	bool *_is_destroyed;
+};
+
+TEST_CASE("suspender_guard nests and restores") {
+	rua::suspender_i def = rua::this_suspender();
+	REQUIRE(def);
+
+	bool is_destroyed = false;
+	rua::suspender_i kept;
+	{
+		rua::suspender_guard sg1(
+			std::make_shared<test_suspender>(&is_destroyed));
+		auto a = rua::this_suspender();
+		REQUIRE(a != def);
+		REQUIRE(sg1.previous() == def);
+		{
+			rua::suspender_guard sg2(std::make_shared<test_suspender>());
+			REQUIRE(rua::this_suspender() != a);
+			REQUIRE(sg2.previous() == a);
+		}
+		REQUIRE(rua::this_suspender() == a);
+		kept = rua::this_suspender();
+	}
+	REQUIRE(rua::this_suspender() == def);
+
+	// A copy shares ownership after the guard is gone.
+	REQUIRE(!is_destroyed);
+	kept.reset();
+	REQUIRE(is_destroyed);
+}
+
+struct suspender_user {
+	~suspender_user() {
+		rua::this_suspender()->yield();
+	}
+};
+
+TEST_CASE("this_suspender while thread vars are destroyed") {
+	static rua::thread_var<suspender_user> tv;
+
+	rua::thread([]() mutable {
+		rua::this_suspender()->yield();
+		tv.emplace();
+	}).wait_for_exit();
+}
+
+#ifndef RUA_NO_NODE_POOL
+
+TEST_CASE("node_pool reuses freed nodes") {
+	auto ptr = rua::node_pool<24>::alloc();
+	rua::node_pool<24>::free(ptr);
+	REQUIRE(rua::node_pool<24>::alloc() == ptr);
+	rua::node_pool<24>::free(ptr);
+
+	static void *moved_ptr = nullptr;
+	rua::thread([]() mutable {
+		for (int i = 0; i < 1000; ++i) {
+			rua::node_pool<24>::free(rua::node_pool<24>::alloc());
+		}
+		moved_ptr = rua::node_pool<24>::alloc();
+		rua::node_pool<24>::free(moved_ptr);
+	}).wait_for_exit();
+
+	// Blocks of an exited thread move to the global free list.
+	bool is_reused = false;
+	std::vector<void *> ptrs;
+	for (int i = 0; i < 256 && !is_reused; ++i) {
+		ptrs.emplace_back(rua::node_pool<24>::alloc());
+		is_reused = ptrs.back() == moved_ptr;
+	}
+	for (auto p : ptrs) {
+		rua::node_pool<24>::free(p);
+	}
+	REQUIRE(is_reused);
+}
+
+#endif
+
+#ifdef __cpp_aligned_new
+
+struct alignas(64) cache_line_val {
+	int val;
+};
+
+TEST_CASE("over-aligned values in lockfree_queue") {
+	static rua::lockfree_queue<cache_line_val> que;
+
+	for (int i = 0; i < 100; ++i) {
+		auto ptr = rua::node_pool<64, 64>::alloc();
+		REQUIRE(!(reinterpret_cast<uintptr_t>(ptr) % 64));
+		rua::node_pool<64, 64>::free(ptr);
+
+		que.emplace(cache_line_val{i});
+	}
+	for (int i = 0; i < 100; ++i) {
+		REQUIRE(que.pop().value().val == i);
+	}
+}
+
+#endif
+
+#ifdef RUA_LOCK_PROF
+
+TEST_CASE("lock_prof records contention") {
+	static rua::mutex mtx("test::lock_prof");
+
+	mtx.lock();
+	auto td = rua::thread([]() mutable {
+		mtx.lock();
+		mtx.unlock();
+	});
+	rua::sleep(20);
+	mtx.unlock();
+	td.wait_for_exit();
+
+	bool is_found = false;
+	for (auto &st : rua::lock_prof_report()) {
+		if (st.name != "test::lock_prof") {
+			continue;
+		}
+		is_found = true;
+		REQUIRE(st.acquisitions == 2);
+		REQUIRE(st.contended_acquisitions == 1);
+		REQUIRE(st.max_wait >= 10);
+		REQUIRE(st.total_wait == st.max_wait);
+	}
+	REQUIRE(is_found);
+}
+
+#endif
+
+TEST_CASE("thread_pool bounds, steals and reaps workers") {
+	rua::thread_pool pool(0, 2, 50);
+
+	std::vector<rua::future<int>> futs;
+	for (int i = 1; i <= 100; ++i) {
+		futs.emplace_back(pool.submit([i]() -> int { return i; }));
+	}
+	int sum = 0;
+	for (auto &fut : futs) {
+		sum += fut.get();
+	}
+	REQUIRE(sum == 5050);
+	REQUIRE(pool.worker_count() <= 2);
+
+	// The subtask is queued on the worker running the outer task, which
+	// blocks on it, so only the other worker can run it by stealing.
+	static rua::tid_t outer_tid, inner_tid;
+	auto outer = pool.submit([&pool]() {
+		outer_tid = rua::this_tid();
+		auto inner = pool.submit([]() { inner_tid = rua::this_tid(); });
+		inner.get();
+	});
+	outer.get();
+	REQUIRE(inner_tid != outer_tid);
+
+	rua::sleep(300);
+	REQUIRE(pool.worker_count() == 0);
+
+	REQUIRE(rua::async_submit([]() -> int { return 1; }).get() == 1);
+}
+
+TEST_CASE("async tasks do not wait behind blocking calls") {
+	static std::atomic<size_t> blocking_c(0);
+
+	auto &blocking = rua::blocking_pool();
+	for (size_t i = 0; i < blocking.max_worker_count(); ++i) {
+		blocking.post([]() {
+			++blocking_c;
+			rua::sleep(500);
+			--blocking_c;
+		});
+	}
+	rua::sleep(50);
+	REQUIRE(blocking_c == blocking.max_worker_count());
+
+	auto fut = rua::async_submit([]() -> int { return 1; });
+	REQUIRE(fut.try_get(200).value() == 1);
+	REQUIRE(blocking_c == blocking.max_worker_count());
+
+	while (blocking_c) {
+		rua::sleep(10);
+	}
+}
+
+TEST_CASE("thread_pool runs tasks posted after reaping") {
+	rua::thread_pool pool(0, 2, 50);
+
+	REQUIRE(pool.submit([]() -> int { return 1; }).get() == 1);
+	rua::sleep(300);
+	REQUIRE(pool.worker_count() == 0);
+
+	auto fut = pool.submit([]() -> int { return 2; });
+	REQUIRE(fut.try_get(1000).value() == 2);
+}